@@ -0,0 +1,66 @@
+#pragma once
+
+#include <chrono>
+#include <iostream>
+#include <string>
+
+// Minimal timing harness: repeatedly runs a kernel until `min_time` has elapsed,
+// then writes one CSV row (`benchmark,params,iterations,ns_per_iter`) to `out`.
+// Human-readable progress goes to `std::cerr` so `out` stays machine-readable.
+class Bench
+{
+	std::ostream &out;
+	const std::string filter;
+	const std::chrono::nanoseconds min_time;
+
+public:
+	Bench(std::ostream &out, const std::string &filter, const std::chrono::milliseconds min_time)
+		: out(out), filter(filter), min_time(min_time)
+	{
+		out << "benchmark,params,iterations,ns_per_iter\n";
+	}
+
+	/**
+	 * Prevents the compiler from optimizing away the computation of `value`.
+	 */
+	template <typename T>
+	static void keep(const T &value)
+	{
+		asm volatile("" : : "r,m"(value) : "memory");
+	}
+
+	/**
+	 * Times `kernel` and records the result under `name` and `params`.
+	 * Skipped if `filter` is nonempty and is not a substring of `name`.
+	 * @param name benchmark name, e.g. `FrequencySpectrum::render`
+	 * @param params semicolon-separated `key=value` pairs describing this case
+	 * @param kernel callable performing exactly one iteration of work
+	 */
+	template <typename F>
+	void run(const std::string &name, const std::string &params, F &&kernel)
+	{
+		if (!filter.empty() && name.find(filter) == std::string::npos)
+			return;
+
+		using clock = std::chrono::steady_clock;
+
+		// warm up caches, lazily allocated buffers and plans
+		kernel();
+
+		long iterations = 0;
+		const auto start = clock::now();
+		auto elapsed = clock::duration::zero();
+		// double the batch size each round to keep clock overhead negligible
+		for (long batch = 1; elapsed < min_time; batch *= 2)
+		{
+			for (long i = 0; i < batch; ++i)
+				kernel();
+			iterations += batch;
+			elapsed = clock::now() - start;
+		}
+
+		const auto ns_per_iter = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count() / iterations;
+		out << name << ',' << params << ',' << iterations << ',' << ns_per_iter << '\n';
+		std::cerr << name << " [" << params << "]: " << ns_per_iter << " ns/iter\n";
+	}
+};
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+// Deterministic synthetic test signals for benchmarking.
+namespace Signals
+{
+	// Sum of three sines (bass, mid, treble) at a fixed amplitude.
+	inline std::vector<float> sines(const int n, const int samplerate)
+	{
+		std::vector<float> v(n);
+		for (int i = 0; i < n; ++i)
+		{
+			const float t = (float)i / samplerate;
+			v[i] = (sin(2 * M_PI * 55 * t) + sin(2 * M_PI * 880 * t) + sin(2 * M_PI * 7040 * t)) / 3;
+		}
+		return v;
+	}
+
+	// Exponential sine sweep from 20 Hz to nyquist over `n` samples.
+	inline std::vector<float> sweep(const int n, const int samplerate)
+	{
+		std::vector<float> v(n);
+		const double f0 = 20, f1 = samplerate / 2., duration = (double)n / samplerate;
+		const double k = log(f1 / f0);
+		for (int i = 0; i < n; ++i)
+		{
+			const double t = (double)i / samplerate;
+			v[i] = sin(2 * M_PI * f0 * duration / k * (exp(t / duration * k) - 1));
+		}
+		return v;
+	}
+
+	// Uniform white noise in [-1, 1] with a fixed seed.
+	inline std::vector<float> noise(const int n)
+	{
+		std::vector<float> v(n);
+		std::mt19937 rng(1234);
+		std::uniform_real_distribution<float> dist(-1, 1);
+		for (auto &x : v)
+			x = dist(rng);
+		return v;
+	}
+};
@@ -0,0 +1,275 @@
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <argparse/argparse.hpp>
+#include <SDL2pp/SDLTTF.hh>
+#include "Signals.hpp"
+#include "Visualizer.hpp"
+#include "YuvConverter.hpp"
+
+namespace fs = std::filesystem;
+
+static const auto samplerate = 44100;
+
+struct Result
+{
+	std::string resolution;
+	int frames;
+	double seconds, fps;
+	size_t bytes_per_frame;
+	long max_rss_kb;
+};
+
+// Writes a stereo 16-bit WAV: a full-range sweep on the left, sines plus noise on the right.
+static void generate_wav(const std::string &path, const int seconds)
+{
+	const auto n = seconds * samplerate;
+	const auto left = Signals::sweep(n, samplerate);
+	auto right = Signals::sines(n, samplerate);
+	const auto noise = Signals::noise(n);
+	for (int i = 0; i < n; ++i)
+		right[i] = 0.8f * right[i] + 0.2f * noise[i];
+
+	std::vector<float> interleaved(2 * n);
+	for (int i = 0; i < n; ++i)
+	{
+		interleaved[2 * i] = left[i];
+		interleaved[2 * i + 1] = right[i];
+	}
+
+	SndfileHandle sf(path, SFM_WRITE, SF_FORMAT_WAV | SF_FORMAT_PCM_16, 2, samplerate);
+	if (sf.error())
+		throw std::runtime_error("cannot write " + path + ": " + sf.strError());
+	if (sf.writef(interleaved.data(), n) != n)
+		throw std::runtime_error("short write to " + path);
+}
+
+// Writes an executable stand-in for ffmpeg that accepts any arguments and discards stdin.
+static void generate_null_sink(const std::string &path)
+{
+	std::ofstream(path) << "#!/bin/sh\nexec cat >/dev/null\n";
+	fs::permissions(path, fs::perms::owner_all);
+}
+
+/**
+ * Runs `Visualizer::encode_to_video` in a child process so that its peak RSS is measured in isolation.
+ * The child reports its frame count and encode time back through a pipe.
+ */
+static Result run_encode(const std::string &wav, const std::string &sink, const std::string &resolution, const int fps)
+{
+	int width, height;
+	if (sscanf(resolution.c_str(), "%dx%d", &width, &height) != 2)
+		throw std::invalid_argument("resolution must be of the form WxH: " + resolution);
+
+	int fds[2];
+	if (pipe(fds) == -1)
+		throw std::runtime_error(std::string("pipe: ") + strerror(errno));
+
+	const auto pid = fork();
+	if (pid == -1)
+		throw std::runtime_error(std::string("fork: ") + strerror(errno));
+
+	if (!pid)
+	{
+		close(fds[0]);
+		// encode_to_video prints its ffmpeg command; keep stdout for results only
+		dup2(open("/dev/null", O_WRONLY), STDOUT_FILENO);
+		try
+		{
+			SDL2pp::SDL sdl(SDL_INIT_VIDEO);
+			SDL2pp::SDLTTF ttf;
+			Visualizer viz(wav, width, height);
+			viz.set_ffmpeg_path(sink);
+			const auto start = std::chrono::steady_clock::now();
+			const int frames = viz.encode_to_video("/dev/null", fps);
+			const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			if (write(fds[1], &frames, sizeof(frames)) != sizeof(frames) || write(fds[1], &seconds, sizeof(seconds)) != sizeof(seconds))
+				_exit(EXIT_FAILURE);
+			_exit(EXIT_SUCCESS);
+		}
+		catch (const std::exception &e)
+		{
+			std::cerr << "bench-encode: " << resolution << ": " << e.what() << '\n';
+			_exit(EXIT_FAILURE);
+		}
+	}
+
+	close(fds[1]);
+	// frames are sent as `yuv420p` by default
+	Result r{resolution, 0, 0, 0, YuvConverter::frame_size(width, height), 0};
+	const bool ok = read(fds[0], &r.frames, sizeof(r.frames)) == sizeof(r.frames) && read(fds[0], &r.seconds, sizeof(r.seconds)) == sizeof(r.seconds);
+	close(fds[0]);
+
+	int status;
+	rusage usage;
+	if (wait4(pid, &status, 0, &usage) == -1)
+		throw std::runtime_error(std::string("wait4: ") + strerror(errno));
+	if (!ok || !WIFEXITED(status) || WEXITSTATUS(status))
+		throw std::runtime_error("encode at " + resolution + " failed");
+
+	r.fps = r.frames / r.seconds;
+	r.max_rss_kb = usage.ru_maxrss;
+	return r;
+}
+
+static const char *const csv_header = "resolution,frames,seconds,fps,bytes_per_frame,max_rss_kb";
+
+static void write_csv(std::ostream &out, const std::vector<Result> &results)
+{
+	out << csv_header << '\n';
+	for (const auto &r : results)
+		out << r.resolution << ',' << r.frames << ',' << r.seconds << ',' << r.fps << ',' << r.bytes_per_frame << ',' << r.max_rss_kb << '\n';
+}
+
+// Returns the baseline results keyed by resolution.
+static std::map<std::string, Result> read_baseline(const std::string &path)
+{
+	std::map<std::string, Result> baseline;
+	std::ifstream in(path);
+	if (!in)
+		throw std::runtime_error("cannot read baseline " + path + "; record one with `make bench-encode-baseline`");
+	std::string line;
+	std::getline(in, line); // header
+	while (std::getline(in, line))
+	{
+		Result r;
+		char resolution[32];
+		if (sscanf(line.c_str(), "%31[^,],%d,%lf,%lf,%zu,%ld", resolution, &r.frames, &r.seconds, &r.fps, &r.bytes_per_frame, &r.max_rss_kb) != 6)
+			continue;
+		r.resolution = resolution;
+		baseline[r.resolution] = r;
+	}
+	return baseline;
+}
+
+/**
+ * Compares `results` against `baseline`.
+ * A result regresses if its fps drops, or its peak RSS grows, by more than `tolerance` (a fraction).
+ * @returns whether every result has a baseline and is within tolerance
+ */
+static bool check_baseline(const std::vector<Result> &results, const std::map<std::string, Result> &baseline, const double tolerance)
+{
+	bool pass = true;
+	for (const auto &r : results)
+	{
+		const auto it = baseline.find(r.resolution);
+		if (it == baseline.end())
+		{
+			// an unchecked resolution must not pass silently
+			std::cerr << r.resolution << ": no baseline recorded, record one with `make bench-encode-baseline`\n";
+			pass = false;
+			continue;
+		}
+		const auto &b = it->second;
+		const bool fps_ok = r.fps >= b.fps * (1 - tolerance),
+				   rss_ok = r.max_rss_kb <= b.max_rss_kb * (1 + tolerance);
+		std::cerr << r.resolution << ": fps " << r.fps << " (baseline " << b.fps << ")" << (fps_ok ? "" : " REGRESSED")
+				  << ", max rss " << r.max_rss_kb << " KiB (baseline " << b.max_rss_kb << ")" << (rss_ok ? "" : " REGRESSED") << '\n';
+		pass &= fps_ok && rss_ok;
+	}
+	return pass;
+}
+
+int main(const int argc, const char *const *const argv)
+{
+	argparse::ArgumentParser args(argv[0]);
+
+	args.add_argument("-d", "--duration")
+		.help("length of the generated stereo test audio in seconds")
+		.default_value(180)
+		.scan<'i', int>();
+
+	args.add_argument("-r", "--fps")
+		.help("video frame rate to encode at")
+		.default_value(60)
+		.scan<'i', int>();
+
+	args.add_argument("--resolutions")
+		.help("resolutions to encode at, each of the form WxH")
+		.nargs(1, 8)
+		.default_value(std::vector<std::string>{"1280x720", "1920x1080", "3840x2160"});
+
+	args.add_argument("-o", "--output")
+		.help("write CSV results to this file instead of stdout");
+
+	args.add_argument("-b", "--baseline")
+		.help("CSV file of baseline results to check against");
+
+	args.add_argument("--tolerance")
+		.help("allowed fractional fps drop or peak RSS growth relative to the baseline")
+		.default_value(0.1)
+		.scan<'g', double>();
+
+	args.add_argument("--update-baseline")
+		.help("overwrite the baseline file with this run's results instead of checking")
+		.default_value(false)
+		.implicit_value(true);
+
+	try
+	{
+		args.parse_args(argc, argv);
+	}
+	catch (const std::exception &e)
+	{
+		std::cerr << argv[0] << ": " << e.what() << '\n'
+				  << args;
+		return EXIT_FAILURE;
+	}
+
+#ifndef __OPTIMIZE__
+	std::cerr << argv[0] << ": warning: built without optimizations, rebuild with `make bench release=1`\n";
+#endif
+
+	// run headless unless told otherwise; the software renderer keeps results reproducible across machines
+	setenv("SDL_VIDEODRIVER", "dummy", 0);
+	setenv("SDL_RENDER_DRIVER", "software", 0);
+
+	const auto tmpdir = fs::temp_directory_path() / ("audioviz-bench-" + std::to_string(getpid()));
+
+	try
+	{
+		fs::create_directories(tmpdir);
+		const auto wav = (tmpdir / "input.wav").string(),
+				   sink = (tmpdir / "ffmpeg").string();
+		generate_wav(wav, args.get<int>("-d"));
+		generate_null_sink(sink);
+
+		std::vector<Result> results;
+		for (const auto &resolution : args.get<std::vector<std::string>>("--resolutions"))
+		{
+			const auto &r = results.emplace_back(run_encode(wav, sink, resolution, args.get<int>("-r")));
+			std::cerr << r.resolution << ": " << r.frames << " frames in " << r.seconds << " s (" << r.fps << " fps), "
+					  << r.bytes_per_frame << " bytes/frame, max rss " << r.max_rss_kb << " KiB\n";
+		}
+		fs::remove_all(tmpdir);
+
+		if (const auto output = args.present("-o"))
+		{
+			std::ofstream out(output.value());
+			write_csv(out, results);
+		}
+		else
+			write_csv(std::cout, results);
+
+		if (const auto baseline = args.present("-b"))
+		{
+			if (args.get<bool>("--update-baseline"))
+			{
+				std::ofstream out(baseline.value());
+				write_csv(out, results);
+			}
+			else if (!check_baseline(results, read_baseline(baseline.value()), args.get<double>("--tolerance")))
+				return EXIT_FAILURE;
+		}
+	}
+	catch (const std::exception &e)
+	{
+		std::cerr << argv[0] << ": " << e.what() << '\n';
+		fs::remove_all(tmpdir);
+		return EXIT_FAILURE;
+	}
+}
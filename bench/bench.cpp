@@ -0,0 +1,400 @@
+#include <fstream>
+#include <argparse/argparse.hpp>
+#include "Bench.hpp"
+#include "Signals.hpp"
+#include "BiquadSpectrum.hpp"
+#include "SpectrumRenderer.hpp"
+#include "YuvConverter.hpp"
+
+using FS = FrequencySpectrum;
+using SR = SpectrumRenderer;
+
+static const auto samplerate = 44100;
+static const auto max_fft_size = 65536;
+static const auto default_fft_size = 4096;
+static const auto default_bars = 256;
+
+static const std::pair<FS::Scale, const char *> scales[]{
+	{FS::Scale::LINEAR, "linear"},
+	{FS::Scale::LOG, "log"},
+	{FS::Scale::NTH_ROOT, "nth-root"}};
+
+static const std::pair<FS::AccumulationMethod, const char *> accum_methods[]{
+	{FS::AccumulationMethod::SUM, "sum"},
+	{FS::AccumulationMethod::MAX, "max"},
+	{FS::AccumulationMethod::FILTERBANK, "filterbank"}};
+
+static const std::pair<FS::WindowFunction, const char *> window_funcs[]{
+	{FS::WindowFunction::NONE, "none"},
+	{FS::WindowFunction::HANNING, "hanning"},
+	{FS::WindowFunction::HAMMING, "hamming"},
+	{FS::WindowFunction::BLACKMAN, "blackman"}};
+
+static const std::pair<FS::InterpolationType, const char *> interp_types[]{
+	{FS::InterpolationType::NONE, "none"},
+	{FS::InterpolationType::LINEAR, "linear"},
+	{FS::InterpolationType::CSPLINE, "cspline"},
+	{FS::InterpolationType::CSPLINE_HERMITE, "cspline_hermite"}};
+
+static const int bar_counts[]{64, 128, 256, 512, 1024};
+
+static void bench_frequency_spectrum(Bench &bench)
+{
+	const std::pair<std::vector<float>, const char *> signals[]{
+		{Signals::sines(max_fft_size, samplerate), "sines"},
+		{Signals::sweep(max_fft_size, samplerate), "sweep"},
+		{Signals::noise(max_fft_size), "noise"}};
+
+	const auto render = [&](FS &fs, const std::vector<float> &signal, const int bars, const std::string &params)
+	{
+		std::vector<float> spectrum(bars);
+		fs.commit();
+		bench.run("FrequencySpectrum::render", params, [&]
+		{
+			fs.copy_to_input(signal.data());
+			fs.render(spectrum);
+			Bench::keep(spectrum.data());
+		});
+	};
+
+	// fft size sweep with default options
+	for (const auto &[signal, signal_name] : signals)
+		for (int fft_size = 512; fft_size <= max_fft_size; fft_size *= 2)
+		{
+			FS fs(fft_size);
+			render(fs, signal, default_bars, std::string("signal=") + signal_name + ";fft_size=" + std::to_string(fft_size) + ";bars=" + std::to_string(default_bars));
+		}
+
+	// the remaining sweeps vary one option at a time around the defaults
+	const auto &[signal, signal_name] = signals[1];
+	const auto base_params = std::string("signal=") + signal_name + ";fft_size=" + std::to_string(default_fft_size);
+
+	for (const auto &[scale, scale_name] : scales)
+		for (const auto &[am, am_name] : accum_methods)
+		{
+			FS fs(default_fft_size);
+			fs.set_scale(scale);
+			fs.set_accum_method(am);
+			render(fs, signal, default_bars, base_params + ";scale=" + scale_name + ";accum=" + am_name);
+		}
+
+	for (const auto &[wf, wf_name] : window_funcs)
+	{
+		FS fs(default_fft_size);
+		fs.set_window_func(wf);
+		render(fs, signal, default_bars, base_params + ";window=" + wf_name);
+	}
+
+	for (const auto &[interp, interp_name] : interp_types)
+		for (const auto bars : bar_counts)
+		{
+			FS fs(default_fft_size);
+			fs.set_interp_type(interp);
+			render(fs, signal, bars, base_params + ";interp=" + interp_name + ";bars=" + std::to_string(bars));
+		}
+
+	// the filterbank needs no interpolation, so compare it against the interpolated sweep above
+	for (const auto bars : bar_counts)
+	{
+		FS fs(default_fft_size);
+		fs.set_accum_method(FS::AccumulationMethod::FILTERBANK);
+		render(fs, signal, bars, base_params + ";accum=filterbank;bars=" + std::to_string(bars));
+	}
+
+	// multi-resolution: equal bass resolution, i.e. the same fft_size, split into more bands
+	for (int bands = 1; bands <= FS::max_bands; ++bands)
+		for (int fft_size = 4096; fft_size <= max_fft_size; fft_size *= 4)
+		{
+			FS fs(default_fft_size);
+			fs.set_fft_size(fft_size);
+			fs.set_resolution_bands(bands);
+			render(fs, signal, default_bars, std::string("signal=") + signal_name + ";fft_size=" + std::to_string(fft_size) + ";bands=" + std::to_string(bands));
+		}
+
+	// surround: every channel in one batched transform, then binned one by one, as when drawing each channel
+	for (const auto channels : {1, 2, 6, FS::max_channels})
+	{
+		FS fs(default_fft_size);
+		fs.set_channels(channels);
+		fs.commit();
+		std::vector<float> audio(default_fft_size * channels), spectrum(default_bars);
+		for (int i = 0; i < default_fft_size; ++i)
+			for (int c = 0; c < channels; ++c)
+				audio[i * channels + c] = signal[i];
+		bench.run("FrequencySpectrum::transform+render", base_params + ";channels=" + std::to_string(channels), [&]
+		{
+			fs.copy_channels_to_input(audio.data(), channels);
+			fs.transform();
+			for (int c = 0; c < channels; ++c)
+			{
+				fs.render(fs.bins(c), spectrum);
+				Bench::keep(spectrum.data());
+			}
+		});
+	}
+
+	// decimation alone, as done once per extra band
+	for (int fft_size = 4096; fft_size <= max_fft_size; fft_size *= 4)
+	{
+		const std::vector<float> input(signal.begin(), signal.begin() + fft_size);
+		std::vector<float> decimated(fft_size / 4);
+		bench.run("FrequencySpectrum::decimate", "fft_size=" + std::to_string(fft_size), [&]
+		{
+			FS::decimate(input, decimated);
+			Bench::keep(decimated.data());
+		});
+	}
+
+	// interpolation alone: render once without interpolation to get a gapped spectrum,
+	// then time only the gap filling (plus a cheap copy to restore the gaps)
+	for (const auto &[interp, interp_name] : interp_types)
+	{
+		if (interp == FS::InterpolationType::NONE)
+			continue;
+		for (const auto bars : bar_counts)
+		{
+			FS fs(default_fft_size);
+			fs.set_interp_type(FS::InterpolationType::NONE);
+			fs.commit();
+			std::vector<float> gapped(bars), spectrum(bars);
+			fs.copy_to_input(signal.data());
+			fs.render(gapped);
+			fs.set_interp_type(interp);
+			fs.commit();
+			bench.run("FrequencySpectrum::interpolate", base_params + ";interp=" + interp_name + ";bars=" + std::to_string(bars), [&]
+			{
+				spectrum = gapped;
+				fs.interpolate(spectrum);
+				Bench::keep(spectrum.data());
+			});
+		}
+	}
+}
+
+static void bench_biquad_spectrum(Bench &bench)
+{
+	// one hop of a 60 fps display, the newest audio the biquad engine filters per frame
+	static const auto hop = samplerate / 60;
+	const auto signal = Signals::sweep(hop, samplerate);
+	for (const auto bars : bar_counts)
+	{
+		BiquadSpectrum bq(samplerate);
+		std::vector<float> spectrum(bars);
+		bq.reset(bars);
+		bench.run("BiquadSpectrum::process+render", "hop=" + std::to_string(hop) + ";bars=" + std::to_string(bars), [&]
+		{
+			bq.process(signal.data(), hop, 1, 0);
+			bq.render(spectrum);
+			Bench::keep(spectrum.data());
+		});
+	}
+}
+
+static void bench_color(Bench &bench)
+{
+	static const auto calls = 1024;
+	bench.run("ColorUtils::hsvToRgb", "calls=" + std::to_string(calls), []
+	{
+		for (int i = 0; i < calls; ++i)
+		{
+			const auto [r, g, b] = ColorUtils::hsvToRgb((float)i / calls + 0.9f, 0.7f, 1);
+			Bench::keep(r + g + b);
+		}
+	});
+}
+
+static void bench_drawing(Bench &bench)
+{
+	static const auto width = 1920, height = 1080;
+	// number of primitives drawn per iteration, spread across the target
+	static const auto count = 64;
+
+	SDL2pp::Window window("audioviz-bench", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, width, height, SDL_WINDOW_HIDDEN);
+	SR sr(default_fft_size, window, SDL_RENDERER_SOFTWARE);
+	sr.commit_analysis();
+
+	// SDL batches draw calls, so flush to make sure each iteration includes the actual rasterization
+	const auto primitive = [&](const char *name, const std::string &params, auto &&draw)
+	{
+		bench.run(name, params + ";count=" + std::to_string(count), [&]
+		{
+			for (int i = 0; i < count; ++i)
+				draw(i);
+			SDL_RenderFlush(sr.Get());
+		});
+	};
+
+	for (const Sint16 h : {100, 800})
+	{
+		const auto y = height - 1;
+		const auto hs = ";h=" + std::to_string(h);
+
+		primitive("vlineRGBA", "w=1" + hs, [&](const int i)
+				  { vlineRGBA(sr.Get(), i * 6 % width, y - h, y, 255, 0, 0, 255); });
+
+		for (const Sint16 w : {4, 10, 32})
+		{
+			const auto ws = "w=" + std::to_string(w) + hs;
+			primitive("MyRenderer::drawBoxFromBottomLeft", ws, [&](const int i)
+					  { sr.drawBoxFromBottomLeft(i * (w + 5) % (width - w), y, w, h, 255, 0, 0); });
+			primitive("MyRenderer::drawPillFromBottomLeft", ws, [&](const int i)
+					  { sr.drawPillFromBottomLeft(i * (w + 5) % (width - w), y, w, h, 255, 0, 0); });
+			if (w >= 10)
+				primitive("MyRenderer::drawCoolPillFromBottomLeft", ws, [&](const int i)
+						  { sr.drawCoolPillFromBottomLeft(i * (w + 5) % (width - w), y, w, h, 255, 0, 0); });
+		}
+	}
+
+	for (const Sint16 rad : {2, 5, 16})
+		primitive("MyRenderer::drawCircleFromBottomLeft", "rad=" + std::to_string(rad), [&](const int i)
+				  { sr.drawCircleFromBottomLeft(i * (2 * rad + 5) % (width - 2 * rad), height - 1, rad, 255, 0, 0); });
+
+	// whole spectrum: analysis + drawing, as done once per channel per frame
+	const auto signal = Signals::sweep(default_fft_size, samplerate);
+	for (const auto rect_w : {800, width})
+		for (const auto &[bar_type, bar_type_name] : {std::pair{SR::BarType::RECTANGLE, "bar"}, std::pair{SR::BarType::PILL, "pill"}})
+			for (const uint bar_width : {1u, 10u})
+			{
+				sr.bar.set_type(bar_type);
+				sr.bar.set_width(bar_width);
+				const SDL2pp::Rect rect(0, 0, rect_w, height);
+				bench.run("SpectrumRenderer::render_spectrum", "rect_w=" + std::to_string(rect_w) + ";bar_type=" + bar_type_name + ";bar_width=" + std::to_string(bar_width), [&]
+				{
+					sr.copy_channel_to_input(signal.data(), 1, 0, false);
+					sr.render_spectrum(rect, false);
+					SDL_RenderFlush(sr.Get());
+				});
+			}
+
+	// the cpu rasterizer drawing the same spectra into a whole frame, as done per frame by `Visualizer::encode_to_video`,
+	// checked against the SDL path on the same spectrum
+	std::vector<uint32_t> frame(width * height), reference(width * height);
+	for (const auto &[bar_type, bar_type_name] : {std::pair{SR::BarType::RECTANGLE, "bar"}, std::pair{SR::BarType::PILL, "pill"}})
+		for (const uint bar_width : {1u, 10u})
+		{
+			sr.bar.set_type(bar_type);
+			sr.bar.set_width(bar_width);
+			const SDL2pp::Rect rect(0, 0, width, height);
+			std::vector<float> spectrum(sr.bar_count(rect));
+			sr.copy_channel_to_input(signal.data(), 1, 0, false);
+			sr.analyze(spectrum);
+
+			sr.SetDrawColor().Clear();
+			sr.draw_spectrum(spectrum, rect, false);
+			sr.ReadPixels(SDL2pp::NullOpt, SDL_PIXELFORMAT_ARGB8888, reference.data(), 4 * width);
+			FrameRasterizer check(width, height, 1);
+			sr.draw_spectrum(spectrum, rect, false, check);
+			check.render(frame.data());
+			int max_diff = 0, differing = 0;
+			for (size_t i = 0; i < frame.size(); ++i)
+			{
+				int diff = 0;
+				for (const int shift : {0, 8, 16})
+					diff = std::max(diff, std::abs((int)(frame[i] >> shift & 0xff) - (int)(reference[i] >> shift & 0xff)));
+				max_diff = std::max(max_diff, diff);
+				differing += diff > 0;
+			}
+			std::cerr << "FrameRasterizer vs SDL (bar_type=" << bar_type_name << ";bar_width=" << bar_width << "): "
+					  << differing << " pixels differ, by at most " << max_diff << '\n';
+
+			for (const int threads : {1, 4})
+			{
+				FrameRasterizer raster(width, height, threads);
+				bench.run("FrameRasterizer::render", "w=" + std::to_string(width) + ";h=" + std::to_string(height) + ";bar_type=" + bar_type_name + ";bar_width=" + std::to_string(bar_width) + ";threads=" + std::to_string(threads), [&]
+				{
+					sr.draw_spectrum(spectrum, rect, false, raster);
+					raster.render(frame.data());
+					Bench::keep(frame.data());
+				});
+			}
+		}
+
+	// converting a rasterized frame for the encoder, as done per frame in `Visualizer::encode_to_video`
+	std::vector<uint8_t> yuv(YuvConverter::frame_size(width, height));
+	for (const auto &[format, format_name] : {std::pair{YuvConverter::OutputFormat::YUV420P, "yuv420p"}, std::pair{YuvConverter::OutputFormat::NV12, "nv12"}})
+		for (const int threads : {1, 4})
+		{
+			YuvConverter converter(width, height, YuvConverter::InputFormat::BGRA, format, threads);
+			bench.run("YuvConverter::convert", "w=" + std::to_string(width) + ";h=" + std::to_string(height) + ";format=" + format_name + ";threads=" + std::to_string(threads), [&]
+			{
+				converter.convert(frame.data(), yuv.data());
+				Bench::keep(yuv.data());
+			});
+		}
+
+	// clearing and reading back a full frame, as done per frame in `Visualizer::encode_to_video`
+	std::vector<Uint8> pixels(3 * width * height);
+	bench.run("SDL2pp::Renderer::Clear", "w=" + std::to_string(width) + ";h=" + std::to_string(height), [&]
+	{
+		sr.SetDrawColor().Clear();
+		SDL_RenderFlush(sr.Get());
+	});
+	bench.run("SDL2pp::Renderer::ReadPixels", "w=" + std::to_string(width) + ";h=" + std::to_string(height) + ";format=rgb24", [&]
+	{
+		sr.ReadPixels(SDL2pp::NullOpt, SDL_PIXELFORMAT_RGB24, pixels.data(), 3 * width);
+		Bench::keep(pixels.data());
+	});
+}
+
+int main(const int argc, const char *const *const argv)
+{
+	argparse::ArgumentParser args(argv[0]);
+
+	args.add_argument("-o", "--output")
+		.help("write CSV results to this file instead of stdout");
+
+	args.add_argument("-f", "--filter")
+		.help("only run benchmarks whose name contains this string")
+		.default_value(std::string{});
+
+	args.add_argument("-t", "--min-time")
+		.help("minimum time in milliseconds to spend on each case")
+		.default_value(200u)
+		.scan<'u', uint>();
+
+	try
+	{
+		args.parse_args(argc, argv);
+	}
+	catch (const std::exception &e)
+	{
+		std::cerr << argv[0] << ": " << e.what() << '\n'
+				  << args;
+		return EXIT_FAILURE;
+	}
+
+#ifndef __OPTIMIZE__
+	std::cerr << argv[0] << ": warning: built without optimizations, rebuild with `make bench release=1`\n";
+#endif
+
+	std::ofstream file;
+	if (const auto output = args.present("-o"))
+	{
+		file.open(output.value());
+		if (!file)
+		{
+			std::cerr << argv[0] << ": cannot open " << output.value() << '\n';
+			return EXIT_FAILURE;
+		}
+	}
+	std::ostream &out = file.is_open() ? file : std::cout;
+
+	Bench bench(out, args.get("-f"), std::chrono::milliseconds(args.get<uint>("-t")));
+
+	try
+	{
+		bench_frequency_spectrum(bench);
+		bench_biquad_spectrum(bench);
+		bench_color(bench);
+
+		// draw benchmarks use SDL's software renderer on an offscreen window
+		setenv("SDL_VIDEODRIVER", "dummy", 1);
+		SDL2pp::SDL sdl(SDL_INIT_VIDEO);
+		bench_drawing(bench);
+	}
+	catch (const std::exception &e)
+	{
+		std::cerr << argv[0] << ": " << e.what() << '\n';
+		return EXIT_FAILURE;
+	}
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+
+/**
+ * Enforces that the per-frame path performs no heap allocations once warmed up.
+ * Only active when built with `make allocguard=1`, which replaces the global `operator new`/`operator delete`
+ * with counting versions (see `AllocGuard.cpp`). Otherwise all methods are no-ops.
+ */
+class AllocGuard
+{
+#ifdef AUDIOVIZ_ALLOC_GUARD
+	// frames allowed to allocate, giving buffers, plans and SDL's command queue time to settle
+	const int warmup_frames;
+	int frame = 0;
+	size_t frame_start_count = 0;
+
+public:
+	AllocGuard(const int warmup_frames = 2) : warmup_frames(warmup_frames) {}
+
+	/**
+	 * @returns total number of allocations made through `operator new` by the calling thread so far
+	 */
+	static size_t count();
+
+	void begin_frame() { frame_start_count = count(); }
+
+	// starts warming up again, after a reconfiguration that resizes the per-frame buffers
+	void restart() { frame = 0; }
+
+	/**
+	 * @throws `std::runtime_error` if any allocation happened since `begin_frame` and warm-up is over
+	 */
+	void end_frame()
+	{
+		const auto allocations = count() - frame_start_count;
+		if (frame++ >= warmup_frames && allocations)
+			throw std::runtime_error("AllocGuard: " + std::to_string(allocations) + " heap allocation(s) in frame " + std::to_string(frame - 1));
+	}
+#else
+public:
+	AllocGuard(int = 2) {}
+	static size_t count() { return 0; }
+	void begin_frame() {}
+	void restart() {}
+	void end_frame() {}
+#endif
+};
@@ -4,5 +4,8 @@ using argparse::ArgumentParser;
 
 struct Args : protected ArgumentParser
 {
-	Args(const int argc, const char *const *const argv);
+	/**
+	 * @param exit_on_error if true, parse errors print help and exit the process; otherwise they are thrown
+	 */
+	Args(const int argc, const char *const *const argv, bool exit_on_error = true);
 };
\ No newline at end of file
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <SDL2pp/SDL2pp.hh>
+
+/**
+ * Fonts and decoded images shared between `Visualizer`s, so that running many of them in one process
+ * (e.g. batch jobs) loads and decodes each asset once. Textures belong to a renderer, so each caller
+ * gets its own texture created from the shared data.
+ * @note This class is thread safe.
+ */
+class AssetCache
+{
+	std::mutex mutex;
+	std::map<std::tuple<std::string, int, int>, SDL2pp::Font> fonts;
+	std::map<std::string, SDL2pp::Surface> images;
+
+public:
+	/**
+	 * Renders `text` with a cached font into a texture for `renderer`.
+	 * @param font_path path to a TTF font file
+	 * @param size point size of the font
+	 * @param style `TTF_STYLE_*` flags
+	 */
+	SDL2pp::Texture text(SDL2pp::Renderer &renderer, const std::string &font_path, int size, int style, const std::string &text, SDL2pp::Color color);
+
+	/**
+	 * Creates a texture for `renderer` from the image at `path`, decoding it only the first time.
+	 */
+	SDL2pp::Texture image(SDL2pp::Renderer &renderer, const std::string &path);
+};
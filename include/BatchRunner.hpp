@@ -0,0 +1,42 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ * Runs a manifest of jobs in one process, at most `concurrency` at a time.
+ * Each line of the manifest that is not empty or a `#` comment is one job: the arguments you would pass to
+ * audioviz on the command line, e.g. `song.flac --encode song.mp4 60 -n 4096`. Arguments containing spaces
+ * can be quoted with `'` or `"`. A failing job is reported and does not stop the others.
+ */
+class BatchRunner
+{
+public:
+	// arguments of a job, without the program name
+	using Job = std::vector<std::string>;
+
+private:
+	struct Entry
+	{
+		int line;
+		Job args;
+	};
+
+	std::vector<Entry> jobs;
+
+public:
+	/**
+	 * @throws `std::runtime_error` if `manifest` cannot be read or has unterminated quotes
+	 */
+	BatchRunner(const std::string &manifest);
+
+	/**
+	 * Runs every job, printing progress and timing per job to `std::cerr`.
+	 * @param concurrency maximum number of jobs running at once
+	 * @param run_job runs one job; failures are signaled by throwing
+	 * @returns number of failed jobs
+	 * @throws `std::invalid_argument` if `concurrency` is not positive
+	 */
+	int run(int concurrency, const std::function<void(const Job &)> &run_job);
+};
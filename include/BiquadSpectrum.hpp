@@ -0,0 +1,79 @@
+#pragma once
+
+#include <vector>
+#include "FrequencySpectrum.hpp"
+
+/**
+ * Low-latency alternative to `FrequencySpectrum`: a bank of band-pass biquads, one per spectrum index,
+ * each followed by a peak envelope follower. Audio is filtered sample by sample as it arrives, so a spectrum reflects
+ * the newest samples instead of a whole FFT window; latency is only the filters' own settling time.
+ * Fills the same kind of spectrum vector as `FrequencySpectrum::render`. Keeps filter state between calls,
+ * so each instance must see one channel's samples in order.
+ */
+class BiquadSpectrum
+{
+	using FS = FrequencySpectrum;
+
+	// a filter's Q is capped so that bass bands still settle within a few periods
+	static constexpr float max_q = 8;
+	// envelopes fall by 1/e within this many seconds, or two periods of the band's center frequency if longer
+	static constexpr float release_time = 0.01;
+	// lowest center frequency on the `LOG` scale, which has no natural lower bound
+	static constexpr float min_frequency = 20;
+
+	const int samplerate;
+	FS::Scale scale = FS::Scale::LOG;
+	int nth_root = 2;
+	// scale and nth root the filters were last designed for
+	FS::Scale designed_scale = scale;
+	int designed_nth_root = nth_root;
+
+	// per band, structure of arrays so that `process` vectorizes across bands.
+	// coefficients of the normalized RBJ band-pass (b1 is always zero, and b2 = -b0), and its transposed direct form II state
+	std::vector<float> b0, a1, a2, z1, z2;
+	// envelope follower: decay factor per sample, and current envelope
+	std::vector<float> release, envelope;
+
+	// center frequency of (fractional) spectrum index `x` out of `bands`
+	float frequency(float x, int bands) const;
+
+public:
+	/**
+	 * @param samplerate sample rate of the audio to be processed
+	 * @throws `std::invalid_argument` if `samplerate` is not positive
+	 */
+	BiquadSpectrum(int samplerate);
+
+	/**
+	 * Set the spectrum's frequency scale, as with `FrequencySpectrum`. Takes effect on the next `reset`, or the next
+	 * `process`, which redesigns and resets the filters if the scale changed.
+	 */
+	void set_scale(FS::Scale scale);
+
+	/**
+	 * Set the nth-root to use when using the `NTH_ROOT` scale. Takes effect like `set_scale`.
+	 * @throws `std::invalid_argument` if `nth_root` is zero
+	 */
+	void set_nth_root(int nth_root);
+
+	/**
+	 * Clears the filter state and redesigns the filters for `bands` spectrum indices.
+	 * Allocates if the number of bands grows, so call it before the first frame.
+	 */
+	void reset(int bands);
+
+	/**
+	 * Filters the next `frames` samples of one channel of `audio`, after redesigning the filters if the scale or
+	 * nth root changed since they were designed.
+	 * @param audio interleaved audio with `num_channels` channels
+	 * @throws `std::invalid_argument` if `channel` is not in the range `[0, num_channels)`
+	 */
+	void process(const float *audio, int frames, int num_channels, int channel);
+
+	/**
+	 * Writes the envelope of every band into `spectrum`. If its size differs from the number of bands,
+	 * the filters are redesigned and reset first, and the envelopes start again from zero.
+	 * A full scale sine reads about as high as with `FrequencySpectrum`'s defaults.
+	 */
+	void render(std::vector<float> &spectrum);
+};
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "WorkerPool.hpp"
+#include <cstdint>
+#include <vector>
+
+/**
+ * CPU stand-in for the SDL renderer when encoding: rasterizes the spectrum primitives (boxes, vertical lines and pills)
+ * straight into an ARGB8888 frame buffer, between a cached opaque background layer and a cached overlay layer.
+ * Shapes are recorded first; `render` then composites the frame in horizontal tiles, one per thread.
+ * Output matches `MyRenderer`'s SDL2_gfx drawing, except that pill caps are anti-aliased analytically.
+ */
+class FrameRasterizer
+{
+	struct Shape
+	{
+		// rows covered, inclusive
+		int top, bottom;
+		// a box spans columns `left..right`; a pill is a stadium of `radius` around the segment `(cx, cap_top)..(cx, cap_bottom)`
+		int left, right;
+		int cx, cap_top, cap_bottom, radius;
+		bool pill, antialiased;
+		uint32_t color;
+	};
+
+	const int width, height, tiles;
+
+	std::vector<uint32_t> background, overlay;
+	// rows of `overlay` containing anything, so that compositing can skip the rest
+	int overlay_top = 0, overlay_bottom = 0;
+
+	// shapes recorded since the last `render`, drawn in order
+	std::vector<Shape> shapes;
+
+	// frame being rendered, published to the tiles by `pool.run` along with `shapes`
+	uint32_t *target = nullptr;
+
+	// declared last so that its threads are joined before anything they use is destroyed
+	WorkerPool pool;
+
+	void render_tile(int tile);
+	void draw_pill_row(uint32_t *row, const Shape &pill, int y) const;
+
+public:
+	/**
+	 * @param threads number of tiles rendered in parallel, counting the thread calling `render`
+	 * @throws `std::invalid_argument` if `width`, `height` or `threads` is not positive
+	 */
+	FrameRasterizer(int width, int height, int threads);
+
+	/**
+	 * Set the layer under all shapes, e.g. the background image.
+	 * @param pixels `width * height` opaque ARGB8888 pixels, or empty for black
+	 * @throws `std::invalid_argument` if `pixels` is neither empty nor of size `width * height`
+	 */
+	void set_background(std::vector<uint32_t> pixels);
+
+	/**
+	 * Set the layer over all shapes, e.g. text, as drawn over transparent black: its colors are premultiplied by alpha.
+	 * @param pixels `width * height` ARGB8888 pixels, or empty for none
+	 * @throws `std::invalid_argument` if `pixels` is neither empty nor of size `width * height`
+	 */
+	void set_overlay(std::vector<uint32_t> pixels);
+
+	/**
+	 * Records an opaque box with inclusive corners, like `boxRGBA` and `vlineRGBA`.
+	 */
+	void box(int x1, int y1, int x2, int y2, uint8_t r, uint8_t g, uint8_t b);
+
+	/**
+	 * Records an opaque pill, with the same geometry as `MyRenderer::drawPillFromBottomLeft`.
+	 */
+	void pill_from_bottom_left(int x, int y, int w, int h, uint8_t r, uint8_t g, uint8_t b);
+
+	/**
+	 * Composites the background, the recorded shapes and the overlay into `frame`, then forgets the shapes.
+	 * @param frame `width * height` ARGB8888 pixels, rows packed
+	 */
+	void render(uint32_t *frame);
+};
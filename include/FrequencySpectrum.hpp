@@ -1,6 +1,10 @@
 #pragma once
 
+#include <complex>
 #include <cstring>
+#include <memory>
+#include <span>
+#include <stdexcept>
 #include <vector>
 #include "spline.hpp"
 #include "fftwf_dft_r2c_1d.hpp"
@@ -26,7 +30,14 @@ public:
 	enum class AccumulationMethod
 	{
 		SUM,
-		MAX
+		MAX,
+		/**
+		 * Each spectrum index is a triangular filter over the bins, spaced evenly along the frequency scale and
+		 * overlapping its neighbours so that every bin is shared between the two nearest indices. No gaps are left,
+		 * so no interpolation is done. The filters peak at 1 and the bins under each one add up, as with `SUM`: a coarse
+		 * bin of a lower `bands` band counts for the full-resolution bins it spans.
+		 */
+		FILTERBANK
 	};
 
 	enum class WindowFunction
@@ -37,52 +48,179 @@ public:
 		BLACKMAN
 	};
 
-private:
-	// fft size
-	int fft_size;
+	static constexpr int max_bands = 3;
+	static constexpr int max_channels = 8;
 
-	// nth root
-	int nth_root = 2;
-	float nthroot_inv = 1.f / nth_root;
+	// complex FFT output of every band, lowest frequencies first, as produced by `transform`
+	using Bins = std::vector<std::complex<float>>;
 
-	// fftw initialization
-	fftwf_dft_r2c_1d fftw = fft_size;
+	// weights of a spectrum derived from a stereo pair, see `mix`
+	struct StereoView
+	{
+		float left, right;
+	};
 
-	// interpolation
-	tk::spline spline;
-	InterpolationType interp = InterpolationType::CSPLINE;
+	/**
+	 * Options controlling the analysis. Cheap to copy; turned into a `Config` to be used for rendering.
+	 */
+	struct Options
+	{
+		int fft_size;
+		Scale scale = Scale::LOG;
+		int nth_root = 2;
+		InterpolationType interp = InterpolationType::CSPLINE;
+		AccumulationMethod am = AccumulationMethod::MAX;
+		WindowFunction wf = WindowFunction::BLACKMAN;
+
+		/**
+		 * Number of resolution bands, from 1 to `max_bands`. With more than one, the input is analyzed with
+		 * several FFTs of size `fft_size / 4^(bands - 1)`: band 0 on the most recent samples at full rate for
+		 * responsive treble, and each further band on the whole input decimated by another factor of 4 for
+		 * bass resolution equal to a single `fft_size` FFT. Their bins are stitched into the same spectrum.
+		 */
+		int bands = 1;
 
-	// output spectrum scale
-	Scale scale = Scale::LOG;
+		/**
+		 * Number of channels analyzed together, from 1 to `max_channels`. Their FFTs run as one batched FFTW plan,
+		 * split across threads, and share every lookup table; see `copy_channels_to_input`.
+		 */
+		int channels = 1;
 
-	// method for accumulating amplitudes in frequency bins
-	AccumulationMethod am = AccumulationMethod::MAX;
+		/**
+		 * @throws `std::invalid_argument` if `fft_size` is not positive, `nth_root` is zero,
+		 * `bands` is out of range or too large for `fft_size`, or `channels` is out of range
+		 */
+		void validate() const;
 
-	// window function
-	WindowFunction wf = WindowFunction::BLACKMAN;
+		// size of each band's fft
+		int band_fft_size() const { return fft_size >> (2 * (bands - 1)); }
+
+		bool operator==(const Options &) const = default;
+	};
 
-	// struct to hold the "max"s used in `calc_index_ratio`
-	struct
+	/**
+	 * Everything `render` needs that is derived from `Options`: the FFTW plan and buffers, and lookup tables.
+	 * Building one plans an FFT and allocates, so it can be slow; it is built by `commit`, or on any thread and then
+	 * handed to a `FrequencySpectrum` with `swap_config`. Once handed over, only the rendering thread may touch it.
+	 */
+	class Config
 	{
-		double linear, log, sqrt, cbrt, nthroot;
-		void set(const FrequencySpectrum &fs)
+		friend class FrequencySpectrum;
+
+		const Options opts;
+
+		// one transform of size `opts.band_fft_size()` per channel, shared by all bands
+		fftwf_dft_r2c_1d fftw;
+
+		// only used with multiple bands: the input, followed by the input decimated by 4, 16, ...
+		// `levels[b]` holds `fft_size / 4^b` samples per channel, one channel after the other, and is analyzed by band `b`.
+		// with a single band the input is copied straight into `fftw`.
+		std::vector<std::vector<float>> levels;
+
+		// window function sampled at every fft input index; empty for `WindowFunction::NONE`
+		std::vector<float> window;
+
+		// the "max"s used in `calc_index_ratio`
+		struct
+		{
+			double linear, log, sqrt, cbrt, nthroot;
+		} scale_max;
+
+		struct Band
 		{
-			const auto max = fs.fftw.output_size();
-			linear = max;
-			log = ::log(max);
-			sqrt = ::sqrt(max);
-			cbrt = ::cbrt(max);
-			nthroot = ::pow(max, fs.nthroot_inv);
-		}
-	} scale_max;
+			// range of fft output bins this band contributes
+			int first_bin, end_bin;
+			// width of this band's bins in full-resolution bins (bins of an `fft_size` fft)
+			int bin_width;
+			// spectrum index of every bin in the range, valid for spectra of size `bin_index_size`; unused with a filterbank
+			std::vector<int> bin_index;
+			// index of `first_bin` in `bins`
+			int offset = 0;
+		};
+		std::vector<Band> bands;
+
+		// spectrum size that the bin indices or the filterbank were built for
+		size_t bin_index_size = 0;
+
+		// output of the last `transform`, per channel
+		std::vector<Bins> bins;
+
+		// only used with `AccumulationMethod::FILTERBANK`: amplitude, frequency and width (in full-resolution bins)
+		// of each of `bins`
+		std::vector<float> amplitudes, bin_positions, bin_widths;
+
+		/**
+		 * Sparse filterbank matrix in CSR form, one row per spectrum index. A triangular filter covers a contiguous
+		 * run of bins, so each row stores the first column of its run instead of a column index per weight.
+		 * Rebuilt only when the spectrum size changes, for a given config.
+		 */
+		struct
+		{
+			std::vector<int> row_start, first_column;
+			std::vector<float> weights;
+			// scratch: position of each bin in spectrum indices
+			std::vector<float> bin_bars;
+		} filterbank;
+
+		float *input(const int channel) { return levels.empty() ? fftw.input(channel) : levels[0].data() + channel * opts.fft_size; }
+
+	public:
+		/**
+		 * @throws `std::invalid_argument` if `opts` is invalid
+		 */
+		Config(const Options &opts);
+
+		const Options &options() const { return opts; }
+	};
+
+private:
+	// options recorded by the setters, built into `config` by `commit`
+	Options opts;
+
+	// null until the first `commit` or `swap_config`
+	std::unique_ptr<Config> config;
+
+	// interpolation
+	tk::spline spline;
+
+	// spline input points, kept between calls to avoid per-frame allocations
+	std::vector<double> spline_x, spline_y;
 
 public:
 	/**
 	 * Initialize frequency spectrum renderer.
+	 * Nothing is allocated or planned until `commit` is called, so set any other options first.
 	 * @param fft_size sample chunk size fed into the `transform` method
 	 */
 	FrequencySpectrum(int fft_size);
 
+	/**
+	 * Initialize frequency spectrum renderer with all options at once.
+	 * Nothing is allocated or planned until `commit` is called.
+	 * @throws `std::invalid_argument` if `opts` is invalid
+	 */
+	FrequencySpectrum(const Options &opts);
+
+	/**
+	 * @returns options recorded by the setters, which may not have been committed yet
+	 */
+	const Options &options() const { return opts; }
+
+	/**
+	 * Builds the options recorded by the setters into the config used for rendering: allocates buffers,
+	 * plans the FFT and fills lookup tables, exactly once. Does nothing if they are already committed.
+	 * Setters only take effect on `copy_to_input` and `render` after a commit.
+	 */
+	void commit();
+
+	/**
+	 * Replaces the config used for rendering, and the recorded options with its options.
+	 * Does not allocate or plan, so it is safe to call between frames on the rendering thread with a config built elsewhere.
+	 * @param config new config, must not be null
+	 * @returns the previous config, possibly null
+	 */
+	std::unique_ptr<Config> swap_config(std::unique_ptr<Config> config);
+
 	/**
 	 * Set the FFT size used in the `kissfft` library.
 	 * @param fft_size new fft size to use
@@ -128,17 +266,37 @@ public:
 	void set_nth_root(int nth_root);
 
 	/**
-	 * Copies the `wavedata` to the FFTW input buffer for rendering.
+	 * Set the number of channels analyzed together, see `Options::channels`.
+	 * @throws `std::invalid_argument` if `channels` is out of range
+	 */
+	void set_channels(int channels);
+
+	/**
+	 * Set the number of resolution bands, see `Options::bands`.
+	 * @throws `std::invalid_argument` if `bands` is out of range or too large for the fft size
+	 */
+	void set_resolution_bands(int bands);
+
+	/**
+	 * Copies the `wavedata` to the FFTW input buffer for rendering, as the first channel.
 	 * @param wavedata input wave sample data, expected to be of size `fft_size`
 	 */
 	void copy_to_input(const float *wavedata)
 	{
-		memcpy(fftw.input(), wavedata, fft_size * sizeof(float));
+		auto &c = committed_config();
+		memcpy(c.input(0), wavedata, c.opts.fft_size * sizeof(float));
 	}
 
+	/**
+	 * Copies every channel of interleaved `audio` to the FFTW input buffers, in a single pass over `audio`.
+	 * @param audio `fft_size` frames of `num_channels` channels
+	 * @throws `std::invalid_argument` if `num_channels` is not the number of channels in the committed options
+	 */
+	void copy_channels_to_input(const float *audio, int num_channels);
+
 	/**
 	 * This method is meant for audio data.
-	 * Copies a specific channel of the audio buffer to the FFTW input buffer, which is of size `fft_size`.
+	 * Copies a specific channel of the audio buffer to the FFTW input buffer, which is of size `fft_size`, as the first channel.
 	 * If `num_channels` is greater than 1, then `audio` is expected to be of size `num_channels * fft_size`.
 	 * @throws `std::invalid_argument` if `channel` is not in the range `[0, num_channels)`
 	 * @throws `std::invalid_argument` if `num_channels <= 0`
@@ -146,14 +304,79 @@ public:
 	void copy_channel_to_input(const float *audio, int num_channels, int channel, bool interleaved);
 
 	/**
-	 * Performs the FFT on the wave data copied via `copy_channel_to_input`.
-	 * @param spectrum 
+	 * Performs the FFT on the wave data copied via `copy_channel_to_input`, and maps it to `spectrum`.
+	 * Same as `transform` followed by `render(bins(), spectrum)`, for the first channel only.
+	 * @throws `std::logic_error` if `commit` was never called
+	 * @param spectrum output, its size is the number of bars
 	 */
 	void render(std::vector<float> &spectrum);
 
-private:
-	float window_func(int i);
-	int calc_index(int i, int max_index);
-	float calc_index_ratio(float i);
+	/**
+	 * First half of `render`: performs the FFT of every channel on the wave data copied via `copy_channel_to_input`
+	 * or `copy_channels_to_input`. Its output is available from `bins` until the next call.
+	 * @throws `std::logic_error` if `commit` was never called
+	 */
+	void transform();
+
+	/**
+	 * @returns the complex output of the last `transform` for `channel`
+	 * @throws `std::logic_error` if `commit` was never called
+	 */
+	const Bins &bins(const int channel = 0) const { return committed_config().bins.at(channel); }
+
+	/**
+	 * Second half of `render`: maps complex bins to `spectrum`. The bins may be copied or derived (see `mix`)
+	 * from other calls to `transform`, as long as the config has not changed since.
+	 * Not thread safe, even across channels: it reuses scratch buffers and lazily built tables.
+	 * @throws `std::invalid_argument` if `bins` is not the size of `bins()`
+	 */
+	void render(const Bins &bins, std::vector<float> &spectrum);
+
+	/**
+	 * Writes `wa * a + wb * b` to `out`. The FFT is linear, so mixing two channels' bins gives the bins of the same mix
+	 * of their audio, without another transform: mid is `0.5, 0.5` of left and right, and side is `0.5, -0.5`.
+	 * Only allocates if `out` is smaller than `a`.
+	 * @throws `std::invalid_argument` if `a` and `b` differ in size
+	 */
+	static void mix(const Bins &a, float wa, const Bins &b, float wb, Bins &out);
+
+	/**
+	 * Fills in the zeroed gaps of `spectrum` using the current interpolation type.
+	 * Called by `render` when interpolation is enabled; public so it can be benchmarked in isolation.
+	 * @param spectrum spectrum with at least 3 nonzero values
+	 */
 	void interpolate(std::vector<float> &spectrum);
+
+	/**
+	 * Lowpass filters and decimates `in` by 4 into `out`, with the last output aligned to the last input.
+	 * Used by `render` for each extra resolution band; public so it can be benchmarked in isolation.
+	 * @param out must be a quarter of the size of `in`
+	 */
+	static void decimate(std::span<const float> in, std::span<float> out);
+
+private:
+	// applies `update` to a copy of the recorded options, and keeps the copy only if it is valid
+	template <typename F>
+	void update_options(F &&update)
+	{
+		auto opts = this->opts;
+		update(opts);
+		opts.validate();
+		this->opts = opts;
+	}
+
+	Config &committed_config() const
+	{
+		if (!config)
+			throw std::logic_error("FrequencySpectrum: commit() was never called");
+		return *config;
+	}
+
+	static float window_func(WindowFunction wf, int size, int i);
+
+	static void build_filterbank(Config &config, int size);
+	static void apply_filterbank(const Config &config, std::vector<float> &spectrum);
+
+	static float calc_index_ratio(const Config &config, float i);
+	static int calc_index(const Config &config, int i, int max_index);
 };
\ No newline at end of file
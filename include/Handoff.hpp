@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <utility>
+
+/**
+ * Lock-free handoff of heap objects from a producer thread to a consumer thread, such as configs built in the
+ * background and adopted by a render loop. Only the latest published object is kept.
+ * The consumer never frees anything: objects it is done with are `retire`d and freed by the producer in `collect`.
+ * `T` must have a `T *retired_next` member, used to chain retired objects without allocating.
+ */
+template <typename T>
+class Handoff
+{
+	std::atomic<T *> latest = nullptr;
+	std::atomic<T *> retired = nullptr;
+
+	static_assert(std::atomic<T *>::is_always_lock_free);
+
+public:
+	Handoff() = default;
+	Handoff(const Handoff &) = delete;
+	Handoff &operator=(const Handoff &) = delete;
+
+	~Handoff()
+	{
+		delete latest.load();
+		collect();
+	}
+
+	/**
+	 * Producer side: makes `value` the object returned by the next `take`,
+	 * freeing any previously published object that was never taken.
+	 */
+	void publish(std::unique_ptr<T> value)
+	{
+		delete latest.exchange(value.release(), std::memory_order_acq_rel);
+	}
+
+	/**
+	 * Producer side: frees every object retired so far.
+	 */
+	void collect()
+	{
+		for (auto p = retired.exchange(nullptr, std::memory_order_acquire); p;)
+			delete std::exchange(p, p->retired_next);
+	}
+
+	/**
+	 * Consumer side: never blocks or allocates.
+	 * @returns the latest published object, or null if nothing was published since the last call
+	 */
+	std::unique_ptr<T> take()
+	{
+		return std::unique_ptr<T>(latest.exchange(nullptr, std::memory_order_acq_rel));
+	}
+
+	/**
+	 * Consumer side: hands `value` back to the producer to be freed. Never blocks or allocates.
+	 */
+	void retire(std::unique_ptr<T> value)
+	{
+		const auto p = value.release();
+		p->retired_next = retired.load(std::memory_order_relaxed);
+		while (!retired.compare_exchange_weak(p->retired_next, p, std::memory_order_release, std::memory_order_relaxed))
+			;
+	}
+};
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <sndfile.hh>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct AVFormatContext;
+struct AVCodecContext;
+struct AVStream;
+struct AVFrame;
+struct AVPacket;
+struct SwsContext;
+
+/**
+ * In-process alternative to piping raw frames into an `ffmpeg` subprocess: encodes frames with libavcodec and muxes
+ * them with the audio, re-encoded from its decoded PCM, with libavformat. Frames already in the encoder's pixel format
+ * are copied in as is, or filled in place through `frame_planes`; others are converted with swscale on the calling thread. Audio timestamps are exact sample counts.
+ * Only functional when built with `make libav=1`; otherwise `available` is false and the constructor throws.
+ */
+class LibavEncoder
+{
+public:
+	static const bool available;
+
+	enum class InputFormat
+	{
+		// ARGB8888 words, as drawn by `FrameRasterizer`
+		BGRA,
+		RGB24,
+		// 4:2:0 with packed planes, as converted by `YuvConverter`
+		YUV420P,
+		NV12
+	};
+
+private:
+	AVFormatContext *format = nullptr;
+	AVCodecContext *video = nullptr, *audio = nullptr;
+	AVStream *video_stream = nullptr, *audio_stream = nullptr;
+	AVFrame *video_frame = nullptr, *audio_frame = nullptr;
+	AVPacket *packet = nullptr;
+	SwsContext *sws = nullptr;
+
+	const int width, height, fps;
+	const InputFormat input_format;
+
+	SndfileHandle pcm;
+	std::vector<float> pcm_buffer;
+	// samples per audio frame, and whether the last one may be shorter instead of padded with silence
+	int audio_frame_size = 0;
+	bool short_last_frame = false;
+	// video frames and audio samples encoded so far
+	long frames = 0, samples = 0;
+	bool finished = false;
+
+	// sends `frame` (null to flush) to `codec` and writes out every packet it has ready
+	void encode(AVCodecContext *codec, AVStream *stream, AVFrame *frame);
+
+	// encodes the audio up to sample `end`, or to the end of the file if sooner.
+	// unless `last`, only whole audio frames are encoded, and the rest waits for the next call
+	void encode_audio(long end, bool last);
+
+	void cleanup();
+
+public:
+	/**
+	 * @param vcodec encoder or codec name, as with `ffmpeg -c:v`
+	 * @param acodec encoder or codec name, as with `ffmpeg -c:a`; `copy` picks the container's default audio codec,
+	 * since the audio is always re-encoded from its PCM
+	 * @param audio_file audio to mux in, or empty for a video-only output
+	 * @param loglevel an `ffmpeg` log level name such as `error`, or empty to keep libav's default
+	 * @throws `std::runtime_error` if built without libav, or if any libav call fails
+	 */
+	LibavEncoder(const std::string &output_file, int width, int height, int fps, InputFormat input_format,
+				 const std::string &vcodec, const std::string &acodec, const std::string &audio_file, const std::string &loglevel);
+	LibavEncoder(const LibavEncoder &) = delete;
+	~LibavEncoder();
+
+	/**
+	 * Encodes one frame, along with the audio up to its end.
+	 * @param pixels `width * height` pixels in the input format, rows packed
+	 * @throws `std::runtime_error` if encoding or writing fails
+	 */
+	void write(const void *pixels);
+
+	/**
+	 * @returns whether the encoder takes the input format as is, so that frames can be filled in place through
+	 * `frame_planes` instead of being copied in by `write`
+	 */
+	bool in_place() const;
+
+	/**
+	 * Exposes the planes of the next frame, to be filled in place and then encoded with `write_frame`.
+	 * Expects `in_place()`.
+	 * @param planes Y, U and V planes, or Y and UV for `NV12`
+	 * @param strides bytes between rows of each plane
+	 * @throws `std::runtime_error` if the frame can't be made writable
+	 */
+	void frame_planes(uint8_t *planes[3], int strides[3]);
+
+	/**
+	 * Encodes the frame filled through `frame_planes`, along with the audio up to its end.
+	 * @throws `std::runtime_error` if encoding or writing fails
+	 */
+	void write_frame();
+
+	/**
+	 * Encodes the rest of the audio up to the end of the last frame, flushes the encoders and finalizes the file.
+	 * @throws `std::runtime_error` if encoding or writing fails
+	 */
+	void finish();
+};
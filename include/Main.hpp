@@ -1,9 +1,41 @@
 #pragma once
 
 #include "Visualizer.hpp"
+#include "SpectrumDumper.hpp"
 #include "Args.hpp"
+#include "BatchRunner.hpp"
+#include "SegmentedEncode.hpp"
 
-struct Main : Args, public Visualizer
+struct Main : Args
 {
+	using FS = FrequencySpectrum;
+	using SR = SpectrumRenderer;
+
 	Main(const int argc, const char *const *const argv);
-};
\ No newline at end of file
+
+private:
+	// non-null when running as a batch job, in which case rendering is headless and assets are shared between jobs
+	const std::shared_ptr<AssetCache> batch_assets;
+
+	/**
+	 * Runs a single job of a batch: parse errors are thrown instead of exiting the process.
+	 */
+	Main(const int argc, const char *const *const argv, std::shared_ptr<AssetCache> batch_assets);
+
+	void run(int argc, const char *const *argv);
+	void run_batch(const char *program, const std::string &manifest);
+	void run_segments(int argc, const char *const *argv);
+	void run_renditions();
+
+	// applies the options shared by `Visualizer` and `SpectrumDumper`
+	template <typename T>
+	void configure_analysis(T &target);
+
+	// parses `--views`
+	std::vector<FS::StereoView> views();
+
+	void configure_visuals(Visualizer &viz);
+	void dump_spectrum(const std::string &output_file);
+	void visualize();
+	void render(Visualizer &viz);
+};
@@ -12,6 +12,10 @@ protected:
 public:
 	MyRenderer(SDL2pp::Window &window, Uint32 flags);
 
+	// Takes ownership of an existing renderer, e.g. one from `SDL_CreateSoftwareRenderer`.
+	// @throws `SDL2pp::Exception` if `renderer` is null
+	MyRenderer(SDL_Renderer *renderer);
+
 	// (x, y) is the CENTER of the box (filled-color rectangle).
 	void drawBoxCentered(Sint16 x, Sint16 y, Sint16 w, Sint16 h, Uint8 r = 255, Uint8 g = 255, Uint8 b = 255, Uint8 a = 255);
 
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <span>
+#include <vector>
+
+/**
+ * Multi-level min/max summary of a mono signal, for drawing waveforms at any zoom in time proportional to their width.
+ * Level 0 holds the extremes of every `base_block` samples, and each level above those of `factor` peaks below it.
+ * Audio is appended in order as it is read; only the last, partial peak of each level is pending.
+ * Levels finer than any query needs can be left out, which saves most of the memory: level 0 alone holds an eighth
+ * as many floats as the audio.
+ */
+class PeakPyramid
+{
+public:
+	struct Peak
+	{
+		float min, max;
+	};
+
+	static constexpr int base_block = 16, factor = 4, max_levels = 8;
+
+private:
+	// complete peaks of each level, from `finest_level` up
+	std::vector<Peak> levels[max_levels];
+	int finest_level = 0;
+	// peak being accumulated at each level, and how many samples or peaks below it went into it so far
+	Peak pending[max_levels];
+	int pending_count[max_levels]{};
+	long samples = 0;
+
+	// adds a complete peak to `level`, then folds it into the pending peak of the level above
+	void push(int level, Peak peak);
+
+public:
+	/**
+	 * @param expected_samples number of samples to reserve room for, so that appending up to them never allocates
+	 * @param finest_level first level to keep, see `level_for`; queries never use the levels below it
+	 * @throws `std::invalid_argument` if `finest_level` is not in [0, `max_levels`)
+	 */
+	PeakPyramid(long expected_samples = 0, int finest_level = 0);
+
+	/**
+	 * @returns the level `query` reads for `samples_per_pixel`: the coarsest whose peaks are at most a pixel wide
+	 */
+	static int level_for(double samples_per_pixel);
+
+	/**
+	 * Appends audio, downmixed to mono.
+	 * @param audio `frames` interleaved frames of `channels` samples
+	 */
+	void append(const float *audio, int frames, int channels);
+
+	// number of samples appended so far
+	long size() const { return samples; }
+
+	/**
+	 * Fills `out` with the extremes of the audio under each of `out.size()` pixels, pixel `i` covering samples
+	 * `[first + i * samples_per_pixel, first + (i + 1) * samples_per_pixel)`, from the coarsest level whose peaks fit in
+	 * a pixel, or the finest one kept: each pixel gets the extremes of the peaks it overlaps, at most `factor + 1` of them, so a pixel may reach
+	 * into its neighbors by less than its width. Pixels outside the appended audio are silent.
+	 */
+	void query(double first, double samples_per_pixel, std::span<Peak> out) const;
+};
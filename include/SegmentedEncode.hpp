@@ -0,0 +1,54 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+/**
+ * Splits an encode into segments of consecutive frames, each rendered and encoded by its own worker process: this
+ * program run again with the same arguments plus `--segment <index> <count>` (see `Visualizer::set_encode_segment`).
+ * Segments are written without audio to `<output_file>.segments/`, and each one whose worker succeeds is recorded in
+ * a manifest there, so that running the same command again after a crash only encodes the missing ones.
+ * Once all are done, they are concatenated without re-encoding, and the audio is muxed in once over the whole video.
+ */
+class SegmentedEncode
+{
+	const std::string output_file, directory, manifest;
+	const int count;
+	// arguments the workers run with; a manifest recorded with other arguments is stale
+	const std::vector<std::string> args;
+	std::vector<bool> done;
+
+	std::string manifest_header() const;
+	void read_manifest();
+	void record(int index);
+
+public:
+	/**
+	 * Picks up the manifest of a previous run with the same arguments, or starts afresh.
+	 * @param args arguments of this program, without its name
+	 * @throws `std::invalid_argument` if `count` is not positive
+	 * @throws `std::runtime_error` if the segment directory or its manifest can't be written
+	 */
+	SegmentedEncode(const std::string &output_file, int count, const std::vector<std::string> &args);
+
+	/**
+	 * @returns path of segment `index` of an encode to `output_file`, in the same container
+	 */
+	static std::string segment_file(const std::string &output_file, int index);
+
+	/**
+	 * Runs a worker for every segment not done yet, at most `concurrency` at once, printing progress to `std::cerr`.
+	 * @param program name the workers are run under, i.e. `argv[0]`
+	 * @returns number of failed segments
+	 * @throws `std::runtime_error` if a worker can't be started
+	 */
+	int run(const char *program, int concurrency);
+
+	/**
+	 * Concatenates the segments into `output_file` with `ffmpeg`, muxing in `audio_file` with `acodec`,
+	 * then removes the segment directory.
+	 * @throws `std::logic_error` if any segment is not done
+	 * @throws `std::runtime_error` if `ffmpeg` fails
+	 */
+	void concat(const std::string &ffmpeg_path, const std::string &audio_file, const std::string &acodec);
+};
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <sndfile.hh>
+#include "FrequencySpectrum.hpp"
+
+/**
+ * Runs `FrequencySpectrum` over a whole audio file without any rendering, writing the bar values of every
+ * frame to a file or stdout. Runs as fast as the analysis allows instead of in real time.
+ *
+ * `RAW` format, all fields in native (little-endian) byte order:
+ * - header: `char magic[4] = "AVZS"`, `u16 version = 1`, `u16 sample_format` (0 = float32, 1 = uint16),
+ *   `u32 channels`, `u32 bars`, `u32 frames`, `f32 frame_rate`, `u32 sample_rate`, `u32 fft_size`
+ * - followed by `frames` frames of `channels * bars` samples each, channel-major.
+ *   with views, `channels` is the number of views.
+ *
+ * `NPY` format: a NumPy `.npy` (version 1.0) array of shape `(frames, channels, bars)` with dtype `<f4` or `<u2`.
+ *
+ * `uint16` samples are `round(clamp(multiplier * value, 0, 1) * 65535)`, which is the fraction of
+ * the spectrum's height a bar would fill when rendered.
+ */
+class SpectrumDumper
+{
+public:
+	using FS = FrequencySpectrum;
+
+	enum class Format
+	{
+		RAW,
+		NPY
+	};
+
+	enum class SampleFormat
+	{
+		FLOAT32,
+		UINT16
+	};
+
+private:
+	SndfileHandle sf;
+	int sample_size = 3000;
+	FS fs = sample_size;
+
+	// if nonnegative, only dump the specified channel
+	int mono = -1;
+
+	// if not empty, dump these views derived from the stereo pair instead of the channels
+	std::vector<FS::StereoView> views;
+
+	int bars = 64, frame_rate = 60;
+	float multiplier = 4;
+	Format format = Format::RAW;
+	SampleFormat sample_format = SampleFormat::FLOAT32;
+
+public:
+	SpectrumDumper(const std::string &audio_file);
+
+	/**
+	 * Analyzes the whole audio file and writes every frame.
+	 * @param output_file path to write to, or `-` for stdout
+	 * @returns number of frames written
+	 */
+	int dump(const std::string &output_file);
+
+	void set_sample_size(int sample_size);
+	void set_mono(int mono);
+
+	/**
+	 * Dump any number of views derived from the stereo pair, such as mid and side, instead of the channels.
+	 * Each channel is still transformed only once per frame. Overrides `set_mono`.
+	 * @param views empty to dump the channels themselves
+	 * @throws `std::invalid_argument` if `views` is not empty and the audio is not stereo
+	 */
+	void set_views(const std::vector<FS::StereoView> &views);
+	void set_multiplier(float multiplier);
+	void set_interp_type(FS::InterpolationType interp_type);
+	void set_scale(FS::Scale scale);
+	void set_nth_root(int nth_root);
+	void set_resolution_bands(int bands);
+	void set_accum_method(FS::AccumulationMethod method);
+	void set_window_function(FS::WindowFunction wf);
+
+	/**
+	 * Set the number of bars per channel in each frame.
+	 * @throws `std::invalid_argument` if `bars` is not positive
+	 */
+	void set_bars(int bars);
+
+	/**
+	 * Set the number of frames produced per second of audio.
+	 * @throws `std::invalid_argument` if `frame_rate` is not positive
+	 */
+	void set_frame_rate(int frame_rate);
+
+	void set_format(Format format);
+	void set_sample_format(SampleFormat sample_format);
+
+private:
+	int output_channels() const { return views.size() ? views.size() : mono < 0 ? sf.channels() : 1; }
+	void write_header(FILE *out, int frames);
+};
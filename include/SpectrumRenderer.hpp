@@ -2,7 +2,10 @@
 
 #include "MyRenderer.hpp"
 #include "FrequencySpectrum.hpp"
+#include "FrameRasterizer.hpp"
 #include "ColorUtils.hpp"
+#include <array>
+#include <optional>
 
 class SpectrumRenderer : public MyRenderer
 {
@@ -35,11 +38,84 @@ protected:
 	 */
 	std::vector<float> spectrum;
 
+	// waterfall history of one spectrum: a streaming texture with one texel per bar and one row per drawn frame,
+	// written one row at a time as a ring, see `draw_spectrogram`
+	struct History
+	{
+		SDL2pp::Optional<SDL2pp::Texture> texture;
+		int bars = 0, rows = 0;
+		// row written last, i.e. the newest
+		int head = 0;
+		std::vector<uint32_t> row;
+	};
+	std::array<History, FS::max_channels> histories;
+
+	// ARGB8888 color of each spectrogram intensity level, for the color options in `spectrogram_lut_key`
+	std::array<uint32_t, 256> spectrogram_lut;
+	std::optional<std::tuple<ColorMode, RGBTuple, std::tuple<float, float, float>>> spectrogram_lut_key;
+
+	// rebuilds `spectrogram_lut` if the color options changed since it was built
+	void update_spectrogram_lut();
+
+	// unit vectors of the bars of a radial spectrum, computed only when its number of bars or its arc changes
+	struct RadialTable
+	{
+		int bars = 0;
+		float start = 0, sweep = 0;
+		// (cos, sin) of each bar's angle
+		std::vector<SDL_FPoint> directions;
+		// two triangles per bar's quad, in `radial_vertices`
+		std::vector<int> indices;
+	};
+	std::array<RadialTable, FS::max_channels> radial_tables;
+	// four corners per bar, rebuilt every frame; kept between frames to avoid allocations
+	std::vector<SDL_Vertex> radial_vertices;
+
+	/**
+	 * @returns height in pixels of a bar of amplitude `value` out of `max_height`, at least 1
+	 */
+	int bar_height(const float value, const int max_height) const
+	{
+		return std::max(
+			1.f, // must max with 1 because MyRenderer::drawXFromBottomLeft only allows positive dimensions
+				 // and, we want to see the bars at all times
+			round(
+				std::min(
+					(float)max_height,
+					multiplier * std::max(0.f, value) * max_height
+				)
+			)
+		);
+	}
+
+	/**
+	 * Computes the geometry and color of every bar of `spectrum` in `rect`, calls
+	 * `draw_bar(x, h, r, g, b)` for each, then advances the color wheel.
+	 * `x` is the bar's left edge and `h` its height in pixels, at least 1.
+	 */
+	template <typename F>
+	void for_each_bar(const std::vector<float> &spectrum, const SDL2pp::Rect &rect, const bool backwards, F &&draw_bar)
+	{
+		for (int i = 0; i < (int)spectrum.size(); ++i)
+		{
+			const auto [r, g, b] = color.get((float)i / spectrum.size());
+			const int x = backwards ? (rect.GetBottomRight().x - bar.width - i * (bar.width + bar.spacing))
+									: (rect.x + i * (bar.width + bar.spacing));
+			draw_bar(x, bar_height(spectrum[i], rect.h), r, g, b);
+		}
+
+		color.wheel.increment();
+	}
+
 public:
 	SpectrumRenderer(const int sample_size, SDL2pp::Window &window, const Uint32 flags)
 		: MyRenderer(window, flags),
 		  fs(sample_size) {}
 
+	SpectrumRenderer(const int sample_size, SDL_Renderer *const renderer)
+		: MyRenderer(renderer),
+		  fs(sample_size) {}
+
 	// color stuff
 	class
 	{
@@ -83,6 +159,8 @@ public:
 			void set_rate(const float rate) { this->rate = rate; }
 			void set_hsv(const std::tuple<float, float, float> &hsv) { this->hsv = hsv; }
 			void increment() { time += rate; }
+			// advances as many increments at once, e.g. to the first frame of a segment
+			void skip(const long increments) { time += increments * rate; }
 		} wheel;
 	} color;
 
@@ -115,10 +193,87 @@ public:
 	void set_interp_type(const FS::InterpolationType interp_type);
 	void set_scale(const FS::Scale scale);
 	void set_nth_root(const int nth_root);
+	void set_resolution_bands(const int bands);
 	void set_accum_method(const FS::AccumulationMethod method);
 	void set_window_func(const FS::WindowFunction wf);
 	void copy_channel_to_input(const float *audio, int num_channels, int channel, bool interleaved);
 
+	// see `FrequencySpectrum::copy_channels_to_input`
+	void copy_channels_to_input(const float *audio, int num_channels) { fs.copy_channels_to_input(audio, num_channels); }
+
+	const FS::Options &analysis_options() const { return fs.options(); }
+
+	// see `FrequencySpectrum::commit`
+	void commit_analysis();
+
+	// see `FrequencySpectrum::swap_config`
+	std::unique_ptr<FS::Config> swap_analysis_config(std::unique_ptr<FS::Config> config);
+
+	/**
+	 * @returns number of bars that fit in `rect` with the current bar width and spacing
+	 */
+	int bar_count(const SDL2pp::Rect &rect) const { return rect.w / (bar.width + bar.spacing); }
+
+	/**
+	 * Analysis half of `render_spectrum`: renders the spectrum of the input copied via `copy_channel_to_input`.
+	 * Touches no SDL state, so it can run on a different thread than drawing.
+	 * @param spectrum output, its size is the number of bars
+	 */
+	void analyze(std::vector<float> &spectrum) { fs.render(spectrum); }
+
+	// see `FrequencySpectrum::transform`
+	void transform() { fs.transform(); }
+
+	// see `FrequencySpectrum::bins`
+	const FS::Bins &bins(const int channel = 0) const { return fs.bins(channel); }
+
+	/**
+	 * Like `analyze`, but from complex bins obtained through `transform` and `bins`, possibly mixed.
+	 */
+	void analyze(const FS::Bins &bins, std::vector<float> &spectrum) { fs.render(bins, spectrum); }
+
+	/**
+	 * Drawing half of `render_spectrum`: draws `spectrum` as bars in `rect`, and advances the color wheel.
+	 * @param backwards if true, the first bar is drawn at the right edge of `rect`
+	 */
+	void draw_spectrum(const std::vector<float> &spectrum, const SDL2pp::Rect &rect, bool backwards);
+
+	/**
+	 * Like `draw_spectrum`, but records the bars into `target` instead of drawing through SDL.
+	 */
+	void draw_spectrum(const std::vector<float> &spectrum, const SDL2pp::Rect &rect, bool backwards, FrameRasterizer &target);
+
+	/**
+	 * @returns number of bars that fit along an arc of `sweep` radians of a circle of `radius`, at least 1
+	 */
+	int radial_bar_count(const int radius, const float sweep) const { return std::max(1, (int)(radius * std::abs(sweep) / (bar.width + bar.spacing))); }
+
+	/**
+	 * Draws `spectrum` as bars pointing outwards from a circle of `radius` around `center`, the first at angle `start`
+	 * and the others following over `sweep` radians (clockwise on screen if positive), then advances the color wheel.
+	 * All bars are rectangles, drawn as one batch of geometry. Sines and cosines are only computed when the number of
+	 * bars or the arc changes.
+	 * @param length height of a full-scale bar
+	 * @param index which cached table to use, from 0 to `FS::max_channels - 1`; one per spectrum drawn
+	 */
+	void draw_radial_spectrum(const std::vector<float> &spectrum, const SDL2pp::Point &center, int radius, int length, float start, float sweep, int index);
+
+	/**
+	 * Scrolls `spectrum` into the waterfall history of spectrum `index` as its newest row, then draws the history
+	 * into `rect`, newest at the bottom, one column per bar under the bars `draw_spectrum` would draw there.
+	 * Only the new row is uploaded; scrolling is done by where the ring is split when copying it out.
+	 * A change in the number of bars or the height of `rect` starts a new, black history.
+	 * @param index which history to scroll, from 0 to `FS::max_channels - 1`
+	 */
+	void draw_spectrogram(const std::vector<float> &spectrum, const SDL2pp::Rect &rect, bool backwards, int index);
+
+	/**
+	 * Scrolling half of `draw_spectrogram`: adds `spectrum` to the history of spectrum `index`, `rows` high, without
+	 * drawing it. Lets a history pick up from frames that are not drawn, such as those before an encode segment.
+	 * @returns whether there was anything to add
+	 */
+	bool scroll_spectrogram(const std::vector<float> &spectrum, int rows, int index);
+
 	// Assumes you have already called `copy_channel_to_input` beforehand.
 	void render_spectrum(const SDL2pp::Rect &rect, const bool backwards);
 };
\ No newline at end of file
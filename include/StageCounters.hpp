@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+
+/**
+ * Attributes CPU work to the stages of a frame: wall-clock time, and with Linux `perf_event_open`, the cycles,
+ * instructions, cache misses and branch misses (user space only) spent in each stage.
+ * Only active when built with `make perfcounters=1`. Otherwise all methods are no-ops.
+ * Hardware counters only see the thread that opened them, so each thread opens its own on first use. If any thread
+ * can't open them (restricted by `perf_event_paranoid`, or no PMU, as in many VMs), only time is reported.
+ */
+class StageCounters
+{
+public:
+	enum class Stage
+	{
+		// decimation and windowing: everything that prepares the FFT input
+		WINDOW,
+		FFT,
+		// magnitudes and their accumulation into spectrum indices
+		BINNING,
+		INTERPOLATION,
+		DRAW,
+		// copying rendered pixels back from the renderer
+		READBACK,
+		// rgb to yuv, before encoding
+		CONVERT,
+		COUNT
+	};
+
+#ifdef AUDIOVIZ_PERF_COUNTERS
+private:
+	static constexpr int num_counters = 4;
+
+	struct Sample
+	{
+		uint64_t ns, counters[num_counters];
+		static Sample now();
+	};
+
+public:
+	/**
+	 * Attributes all work done by the calling thread from construction until `end` (or destruction) to `stage`.
+	 * Scopes must not overlap on the same thread, or their work is counted twice.
+	 */
+	class Scope
+	{
+		const Stage stage;
+		bool ended = false;
+		const Sample start;
+
+	public:
+		Scope(Stage stage) : stage(stage), start(Sample::now()) {}
+		Scope(const Scope &) = delete;
+		~Scope() { end(); }
+		void end();
+	};
+
+	// counts one frame, the unit the report is divided by
+	static void end_frame();
+
+	/**
+	 * Writes per-frame totals of every stage that ran since the last report, along with IPC, then starts over.
+	 */
+	static void report(std::ostream &out);
+#else
+	class Scope
+	{
+	public:
+		Scope(Stage) {}
+		void end() {}
+	};
+	static void end_frame() {}
+	static void report(std::ostream &) {}
+#endif
+};
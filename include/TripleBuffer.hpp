@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+/**
+ * Lock-free triple buffer: one writer thread repeatedly fills `back()` and calls `publish()`,
+ * one reader thread calls `update()` and reads `front()`. Neither side ever waits for the other,
+ * and the reader always gets the most recently published value; values it was too slow to see are dropped.
+ */
+template <typename T>
+class TripleBuffer
+{
+	static constexpr uint8_t index_mask = 3, fresh_bit = 4;
+
+	T buffers[3];
+
+	// index of the buffer between writer and reader, plus `fresh_bit` if it was published and not yet seen by the reader
+	std::atomic<uint8_t> middle = 1;
+
+	// owned by the writer and the reader respectively
+	uint8_t back_index = 0, front_index = 2;
+
+public:
+	// writer side: the buffer to fill before the next `publish`
+	T &back() { return buffers[back_index]; }
+
+	// writer side: makes `back()` available to the reader, and gets a new back buffer
+	void publish()
+	{
+		back_index = middle.exchange(back_index | fresh_bit, std::memory_order_acq_rel) & index_mask;
+	}
+
+	/**
+	 * Reader side: switches `front()` to the most recently published buffer, if there is a new one.
+	 * @returns whether `front()` changed
+	 */
+	bool update()
+	{
+		if (!(middle.load(std::memory_order_relaxed) & fresh_bit))
+			return false;
+		front_index = middle.exchange(front_index, std::memory_order_acq_rel) & index_mask;
+		return true;
+	}
+
+	// reader side: the most recent buffer seen by `update`
+	const T &front() const { return buffers[front_index]; }
+
+	// calls `f` on all three buffers; only while neither side is using them, e.g. to size them up front
+	template <typename F>
+	void for_each(F &&f)
+	{
+		for (auto &buffer : buffers)
+			f(buffer);
+	}
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * Stereo phase scope (goniometer): plots every sample frame as a point, side (L - R) across and mid (L + R) up,
+ * into a square intensity buffer, which fades by a persistence factor every frame instead of being cleared.
+ * Points are accumulated on the CPU and the whole square is converted to pixels at once, so the cost is one pass over
+ * the samples and one over the square, however many points there are. The per-point coordinates, the fade and the
+ * conversion are plain loops over arrays, which the compiler vectorizes; only the scatter into the buffer is scalar.
+ */
+class Vectorscope
+{
+	// intensity added by each point, out of 255
+	static constexpr int hit = 64;
+
+	const int size;
+	// fraction of the intensity kept from one frame to the next, in 256ths
+	int persistence = 0;
+	std::vector<uint8_t> intensity;
+	// buffer index of each point of the frame being plotted; kept between frames to avoid allocations
+	std::vector<int> points;
+
+public:
+	/**
+	 * @param size width and height of the square, in pixels
+	 * @throws `std::invalid_argument` if `size` is not positive
+	 */
+	Vectorscope(int size);
+
+	int get_size() const { return size; }
+
+	/**
+	 * @param persistence fraction of the intensity kept from one frame to the next; 0 shows only the newest frame
+	 * @throws `std::invalid_argument` if `persistence` is not in `[0, 1)`
+	 */
+	void set_persistence(float persistence);
+
+	/**
+	 * Fades the previous frames, then plots `frames` sample frames. Channels beyond the first two are ignored;
+	 * mono audio plots as a vertical line.
+	 * @param audio interleaved samples, `channels` per frame
+	 */
+	void plot(const float *audio, int frames, int channels);
+
+	/**
+	 * Writes the square as opaque ARGB8888 pixels, from black to the given color with intensity.
+	 * @param pixels top-left pixel of the square
+	 * @param pitch pixels between rows of `pixels`
+	 */
+	void render(uint32_t *pixels, int pitch, uint8_t r, uint8_t g, uint8_t b) const;
+};
@@ -1,9 +1,21 @@
 #pragma once
 
 #include <sndfile.hh>
+#include <array>
 #include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
 #include "PortAudio.hpp"
 #include "SpectrumRenderer.hpp"
+#include "BiquadSpectrum.hpp"
+#include "PeakPyramid.hpp"
+#include "Vectorscope.hpp"
+#include "AssetCache.hpp"
+#include "Handoff.hpp"
+#include "TripleBuffer.hpp"
 
 class Visualizer
 {
@@ -11,60 +23,303 @@ public:
 	using FS = FrequencySpectrum;
 	using SR = SpectrumRenderer;
 
+	enum class AnalysisEngine
+	{
+		// `FrequencySpectrum`: FFT over the last `sample_size` samples
+		FFT,
+		// `BiquadSpectrum`: band-pass filter bank over the newest samples, for low latency
+		BIQUAD
+	};
+
+	// what draws the frames of `encode_to_video`
+	enum class Rasterizer
+	{
+		// the SDL renderer and SDL2_gfx, as when drawing to a window, into a ring of target textures; each frame is
+		// read back while the next one is drawn
+		SDL,
+		// `FrameRasterizer`: bars drawn on the CPU straight into the frame sent to `ffmpeg`
+		CPU
+	};
+
+	// pixel format of the frames handed to the encoder in `encode_to_video`
+	enum class EncodePixelFormat
+	{
+		// as drawn: `bgra` from the `CPU` rasterizer, `rgb24` from `SDL`, leaving conversion to the encoder
+		RGB,
+		// `YuvConverter`: 4:2:0 converted on our side, 1.5 bytes per pixel
+		YUV420P,
+		NV12
+	};
+
+	// what encodes the frames of `encode_to_video`
+	enum class EncoderBackend
+	{
+		// raw frames piped to an `ffmpeg` subprocess
+		FFMPEG,
+		// `LibavEncoder`: libavcodec and libavformat in-process, only available when built with `make libav=1`
+		LIBAV
+	};
+
+	// how spectra are arranged when there are more than one
+	enum class Layout
+	{
+		// as square a grid as possible; stereo is drawn mirrored, left channel growing from the center outwards
+		GRID,
+		// one row per spectrum, each spanning the full width
+		STACKED,
+		// bars pointing outwards from a circle in the middle, with the album art inside; spectra share the circle,
+		// stereo mirrored from the top. drawn through SDL only, so encoding with it uses the `SDL` rasterizer
+		RADIAL
+	};
+
 protected:
 	inline static const char *const blurred_image = ".blurred.jpg";
+	inline static const char *const font_path = "/usr/share/fonts/TTF/Iosevka-Regular.ttc";
 
 	// general parameters
 	int sample_size = 3000;
 	const std::string audio_file;
 
 	// SDL2pp window and renderer
-	SDL2pp::Window window;
-	SR sr = SR(sample_size, window, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+	// headless visualizers have no window, and use a software renderer drawing into `surface` instead
+	SDL2pp::Optional<SDL2pp::Window> window;
+	SDL2pp::Optional<SDL2pp::Surface> surface;
+	SR sr;
 
 	// open audio file
 	SndfileHandle sf = audio_file;
 
-	// intermediate arrays
-	std::vector<float> audio_buffer = std::vector<float>(sample_size * sf.channels());
+	// intermediate arrays, sized by the committed analysis
+	std::vector<float> audio_buffer;
 
 	// if nonnegative, forces a mono spectrum with the specified channel
 	int mono = -1;
 
-	// text font
-	SDL2pp::Font font_large, font_small;
+	// spectra analyzed per second of audio; zero analyzes once per video frame
+	int analysis_rate = 0;
+
+	AnalysisEngine engine = AnalysisEngine::FFT;
+
+	Layout layout = Layout::GRID;
+
+	// whether to draw a scrolling waterfall of past spectra under the bars
+	bool spectrogram = false;
+
+	// seconds of audio across each waveform strip under the spectra, see `set_waveform`
+	std::vector<float> waveform_spans;
+	static constexpr int waveform_height = 48;
+
+	// min/max peaks of the audio read so far by `waveform_sf`, which reads ahead of the frames on its own.
+	// the other vectors are kept between frames to avoid allocations
+	PeakPyramid peaks;
+	SndfileHandle waveform_sf;
+	std::vector<float> waveform_audio;
+	std::vector<PeakPyramid::Peak> waveform_peaks;
+	std::vector<SDL2pp::Point> waveform_points;
+
+	// stereo phase scope in the top right corner, see `set_vectorscope`; its pixels go through a streaming texture
+	std::optional<Vectorscope> vectorscope;
+	SDL2pp::Optional<SDL2pp::Texture> vectorscope_texture;
+	std::vector<uint32_t> vectorscope_pixels;
+
+	Rasterizer rasterizer = Rasterizer::CPU;
+	int raster_threads = std::max(1u, std::thread::hardware_concurrency());
+	EncoderBackend encoder_backend = EncoderBackend::FFMPEG;
+	EncodePixelFormat encode_pixel_format = EncodePixelFormat::YUV420P;
+	// the share of the video `encode_to_video` encodes, see `set_encode_segment`
+	int segment_index = 0, segment_count = 1;
+	// audio analyzed before a segment's first frame, to settle the biquad engine's filters
+	static constexpr int segment_preroll_seconds = 5;
+
+	// with the `BIQUAD` engine: one filter bank per drawn channel, set up by `reset_biquads`
+	std::vector<BiquadSpectrum> biquads;
+
+	// spectra to draw instead of one per channel, derived from the left and right channels' bins
+	std::vector<FS::StereoView> views;
+
+	// bins of the view being analyzed; kept between frames to avoid allocations
+	FS::Bins view_bins;
+
+	// fonts and decoded images, possibly shared with other visualizers
+	const std::shared_ptr<AssetCache> assets;
 
 	struct
 	{
 		SDL2pp::Optional<SDL2pp::Texture> bg, album_art, title_text, artist_text;
 	} texture_opts;
 
-	std::string ffmpeg_path = "ffmpeg";
+	std::string ffmpeg_path = "ffmpeg", ffmpeg_loglevel;
+
+	// the analysis setters only record the wanted options; on `commit_analysis`, `analysis_builder` builds them into
+	// an `Analysis` in the background, which the render loop adopts between frames without blocking (see `adopt_analysis`)
+	struct Analysis
+	{
+		std::unique_ptr<FS::Config> config;
+		std::vector<float> audio_buffer;
+		Analysis *retired_next = nullptr;
+	};
+
+	// guarded by `analysis_mutex`
+	FS::Options requested_analysis{sample_size};
+	std::optional<FS::Options> committed_analysis;
+	bool analysis_requested = false, analysis_building = false;
+
+	std::mutex analysis_mutex;
+	std::condition_variable_any analysis_cv;
+	Handoff<Analysis> analysis_handoff;
+
+	// declared last so that it is stopped and joined before anything it uses is destroyed
+	std::jthread analysis_builder{[this](const std::stop_token stop)
+								  { build_analyses(stop); }};
 
 public:
-	// width and height matter if you are pre-rendering!
-	Visualizer(const std::string &audio_file, int width = 800, int height = 600);
+	/**
+	 * @param width width of the window, or of the rendered frames if headless. matters if you are pre-rendering!
+	 * @param height height of the window, or of the rendered frames if headless. matters if you are pre-rendering!
+	 * @param headless if true, no window is created and SDL's video subsystem is not needed. only `encode_to_video` can be used.
+	 * @param assets cache to load fonts and images through; pass the same cache to share assets between visualizers
+	 */
+	Visualizer(const std::string &audio_file, int width = 800, int height = 600, bool headless = false, std::shared_ptr<AssetCache> assets = std::make_shared<AssetCache>());
 
 	/**
 	 * Starts rendering the visualizer to the window.
 	 * Plays the audio while rendering.
+	 * @throws `std::logic_error` if this visualizer is headless
 	 */
 	void start();
 
 	/**
-	 * Uses `ffmpeg` to encode rendered frames to a video.
+	 * Uses `ffmpeg`, or libav in-process (see `set_encoder_backend`), to encode rendered frames to a video.
 	 * @param output_file output video filename; `ffmpeg` is invoked with `-y` so the file will be overwritten
 	 * @param fps desired frame rate of the video.
 	 * @param vcodec desired video codec. by default does not pass a `-c:v` argument to `ffmpeg`. can error if the codec is incompatible with the output container.
 	 * @param acodec desired audio codec. by default passes `-c:a copy` to `ffmpeg` which can error if the audio's codec is incompatible with the output container.
+	 * with the `LIBAV` backend, `copy` re-encodes the audio with the container's default codec.
+	 * @returns number of video frames sent to `ffmpeg`
+	 */
+	int encode_to_video(const std::string &output_file, int fps, const std::string &vcodec = "h264", const std::string &acodec = "copy");
+
+	// one output of `encode_renditions`, drawn by `viz` at its own size and with its own visual and encoder settings
+	struct Rendition
+	{
+		Visualizer &viz;
+		std::string output_file;
+		int fps;
+		std::string vcodec = "h264", acodec = "copy";
+	};
+
+	/**
+	 * Encodes several videos of this visualizer's audio from a single pass over it: each hop is read and transformed
+	 * once, here, then every rendition bins the transform for its own number of bars, draws and encodes its frames,
+	 * each on its own thread. Renditions at a lower frame rate than the highest blend between hops, as with an
+	 * analysis rate. With the `BIQUAD` engine, only the reading is shared: each rendition runs its own filters.
+	 * @param renditions may include this visualizer itself
+	 * @returns number of video frames encoded per rendition
+	 * @throws `std::invalid_argument` if there are no renditions, an fps is not positive, or a rendition's visualizer
+	 * differs from this one in audio, analysis options, engine or channel mode, or is set to encode a segment
+	 * @throws `std::runtime_error` if any rendition's encoder fails, after the other renditions' threads have stopped
 	 */
-	void encode_to_video(const std::string &output_file, int fps, const std::string &vcodec = "h264", const std::string &acodec = "copy");
+	std::vector<int> encode_renditions(const std::vector<Rendition> &renditions);
 
 	void set_width(int width);
 	void set_height(int height);
 	void set_mono(int mono);
+
+	/**
+	 * Set how multiple spectra are arranged: one per channel of surround audio, or one per view.
+	 */
+	void set_layout(Layout layout);
+
+	/**
+	 * Draw a spectrogram under each spectrum's bars: its past frames scrolling upwards, one row per frame, colored
+	 * by amplitude. Each frame only uploads one row per spectrum. The `CPU` rasterizer can't draw it, so encoding
+	 * with it uses the `SDL` rasterizer.
+	 */
+	void set_spectrogram(bool spectrogram);
+
+	/**
+	 * Draw waveform strips under the spectra, each showing the audio around the current frame at its own zoom.
+	 * Each frame draws every strip from a min/max peak pyramid of the audio, in time proportional to its width,
+	 * whatever the zoom; the pyramid is built as the audio is read ahead of the frames.
+	 * Only the pyramid levels the spans need at the current output width are kept; a wider output draws the
+	 * narrowest span from slightly coarser peaks.
+	 * @param spans seconds of audio across each strip, top to bottom; empty for none
+	 * @throws `std::invalid_argument` if a span is not positive
+	 * @throws `std::runtime_error` if the audio file can't be opened again
+	 */
+	void set_waveform(const std::vector<float> &spans);
+
+	/**
+	 * Draw a vectorscope (goniometer) in the top right corner: every sample of each frame's analysis window as a
+	 * point, side across and mid up, fading over the following frames. Points are rasterized on the CPU into one
+	 * square, which costs one upload and one copy per frame through SDL, whatever the number of points.
+	 * @param size width and height of the square in pixels, or zero for none
+	 * @param persistence fraction of the brightness kept from one frame to the next, in `[0, 1)`
+	 * @throws `std::invalid_argument` if `size` is negative or `persistence` is out of range
+	 */
+	void set_vectorscope(int size, float persistence);
+
+	/**
+	 * Draw up to two views derived from the stereo pair, such as mid and side, instead of the left and right channels.
+	 * Each channel is still transformed only once per frame; the views are mixed from their bins.
+	 * Only applies to the `FFT` engine and overrides `set_mono`.
+	 * @param views empty to draw the channels themselves
+	 * @throws `std::invalid_argument` if there are more than two views, or the audio is not stereo
+	 */
+	void set_views(const std::vector<FS::StereoView> &views);
+
+	/**
+	 * Decouple the analysis rate from the video frame rate: spectra are analyzed `rate` times per second of audio,
+	 * and each video frame blends the two nearest ones. On high refresh rate displays this saves most of the FFT work.
+	 * @param rate spectra per second, or zero to analyze once per video frame
+	 * @throws `std::invalid_argument` if `rate` is negative, or its hop of `samplerate / rate` samples is not between 1
+	 * and the sample size: every hop is played and analyzed out of one `sample_size` buffer
+	 */
+	void set_analysis_rate(int rate);
+	/**
+	 * Set the analysis engine. `BIQUAD` reacts within milliseconds instead of one `sample_size` window, and only
+	 * uses the scale and nth root of the analysis options. It analyzes every hop of audio in order, so `encode_to_video`
+	 * ignores the analysis rate with it.
+	 */
+	void set_analysis_engine(AnalysisEngine engine);
+
+	/**
+	 * Set what draws the frames of `encode_to_video`. With `CPU`, the background and metadata are drawn through SDL
+	 * once, and each frame only rasterizes the bars between them, with no readback.
+	 * @param threads number of threads the `CPU` rasterizer and the yuv conversion split each frame between
+	 * @throws `std::invalid_argument` if `threads` is not positive
+	 */
+	void set_rasterizer(Rasterizer rasterizer, int threads);
+
+	/**
+	 * Set what encodes the frames of `encode_to_video`. `LIBAV` skips the pipe and the subprocess, and takes the same
+	 * codec names and log level; `set_ffmpeg_path` only applies to `FFMPEG`.
+	 * @throws `std::invalid_argument` if `backend` is `LIBAV` but this build lacks libav
+	 */
+	void set_encoder_backend(EncoderBackend backend);
+
+	/**
+	 * Set the pixel format of the frames handed to the encoder in `encode_to_video`. The yuv formats are converted
+	 * across the rasterizer's threads, halving the bytes piped to `ffmpeg` compared to `bgra`.
+	 */
+	void set_encode_pixel_format(EncodePixelFormat format);
+
+	/**
+	 * Make `encode_to_video` encode only one of `count` segments of consecutive frames, split at the same frame
+	 * boundaries whatever the segment, starting with the color wheel where the whole video would have it.
+	 * With more than one segment, the output has no audio: segments are meant to be concatenated, with the audio
+	 * muxed in once (see `SegmentedEncode`).
+	 * @throws `std::invalid_argument` if `count` is not positive or `index` is not in `[0, count)`
+	 */
+	void set_encode_segment(int index, int count);
 	void set_ffmpeg_path(const std::string &path);
 
+	/**
+	 * Set the `-loglevel` passed to `ffmpeg` in `encode_to_video`, or libav's log level with the `LIBAV` backend.
+	 * @param loglevel an `ffmpeg` log level such as `error`, or empty to use `ffmpeg`'s default
+	 */
+	void set_ffmpeg_loglevel(const std::string &loglevel);
+
 	/**
 	 * Set a background image for the spectrum.
 	 * @param filepath path to image file, or empty string to disable background
@@ -73,11 +328,25 @@ public:
 
 	void set_album_art(const std::string &filepath);
 
+	/*
+	 * The analysis setters below (sample size, interpolation, scale, nth root, accumulation method, window function)
+	 * are thread safe and only record the wanted options; nothing is planned or allocated until `commit_analysis`.
+	 */
+
+	/**
+	 * Builds the options recorded by the analysis setters, exactly once: FFT plan, lookup tables and audio buffer.
+	 * The build happens on a background thread and never stalls rendering; it takes effect between two frames once ready.
+	 * `start` and `encode_to_video` commit, and wait for the result, before their first frame.
+	 * Does nothing if the recorded options have not changed since the last commit.
+	 * @note This method is thread safe.
+	 */
+	void commit_analysis();
+
 	/**
 	 * Set the sample chunk size to use in internal calculations.
 	 * @note Smaller values increase responsiveness, but decrease accuracy. Larger values do the opposite.
-	 * @note This method is thread safe.
 	 * @param sample_size new sample size to use
+	 * @throws `std::invalid_argument` if it is smaller than the hop of the analysis rate
 	 */
 	void set_sample_size(int sample_size);
 
@@ -106,6 +375,15 @@ public:
 	 */
 	void set_nth_root(int nth_root);
 
+	/**
+	 * Set the number of resolution bands: with more than one, treble is analyzed on a short window for responsiveness
+	 * and bass on a decimated long window for resolution, for less FFT work than a single long window.
+	 * See `FrequencySpectrum::Options::bands`.
+	 * @param bands number of bands, from 1 to 3
+	 * @throws `std::invalid_argument` if `bands` is out of range or too large for the sample size
+	 */
+	void set_resolution_bands(int bands);
+
 	/**
 	 * Set frequency bin accumulation method.
 	 * @note Choosing `SUM` results in more visible detail in the treble frequencies, at the cost of their amplitudes being visually exaggerated.
@@ -163,7 +441,153 @@ public:
 	void set_color_wheel_hsv(const std::tuple<float, float, float> &hsv);
 
 private:
-	void handle_events();
-	void do_actual_rendering();
+	/**
+	 * Records a change to the analysis options, to be built by the next `commit_analysis`.
+	 * @param update callable modifying the options in place
+	 * @throws `std::invalid_argument` if the resulting options are invalid
+	 */
+	template <typename F>
+	void reconfigure_analysis(F &&update)
+	{
+		const std::lock_guard lock(analysis_mutex);
+		auto opts = requested_analysis;
+		update(opts);
+		opts.validate();
+		requested_analysis = opts;
+	}
+
+	void build_analyses(std::stop_token stop);
+
+	// render thread: switches to the most recently built analysis, if any. never blocks or allocates.
+	// returns whether it switched
+	bool adopt_analysis();
+
+	// render thread: waits for committed analysis changes to be built, then adopts them
+	void wait_for_analysis();
+
+	// spectra of one frame: one per drawn channel, two for stereo
+	struct SpectrumFrame
+	{
+		std::array<std::vector<float>, FS::max_channels> spectra;
+		int count = 0;
+		// first sample of the audio the spectra were analyzed from, and how many samples that was
+		long position = 0;
+		int samples = 0;
+		// with a vectorscope: that audio, interleaved
+		std::vector<float> audio;
+
+		// makes room for `bars` per spectrum and `samples` of audio, so that filling or assigning it allocates nothing
+		void reserve(const int bars, const size_t samples)
+		{
+			for (auto &spectrum : spectra)
+				spectrum.reserve(bars);
+			audio.reserve(samples);
+		}
+
+		// whether `frame` can be assigned to this one without allocating
+		bool fits(const SpectrumFrame &frame) const
+		{
+			for (size_t i = 0; i < spectra.size(); ++i)
+				if (spectra[i].capacity() < frame.spectra[i].size())
+					return false;
+			return audio.capacity() >= frame.audio.size();
+		}
+	};
+
+	// shared between the drawing thread and the playback/analysis thread in `start`
+	struct LiveState
+	{
+		TripleBuffer<SpectrumFrame> spectra;
+		// number of bars per spectrum, set by the drawing thread from the window size
+		std::atomic<int> bars = 0;
+		// number of frames analyzed so far
+		std::atomic<int> frame = 0;
+		std::atomic<bool> done = false;
+	};
+
+	/**
+	 * Playback/analysis thread of `start`: plays the audio and publishes its spectra every `hop` samples.
+	 */
+	void play_and_analyze(std::stop_token stop, int hop, int total_frames, LiveState &state);
+
+	// most bars per spectrum any layout gives on a `width` by `height` output
+	int max_spectrum_bars(int width, int height) const;
+
+	// circle of the `RADIAL` layout, and the length of a full-scale bar
+	struct RadialGeometry
+	{
+		SDL2pp::Point center;
+		int radius, length;
+	};
+	RadialGeometry radial_geometry();
+
+	// start and sweep in radians of the arc spectrum `index` of `count` takes in the `RADIAL` layout
+	std::pair<float, float> radial_arc(int index, int count) const;
+
+	// rectangles to draw `count` spectra in, for the current output size and layout; all empty if `count` is not positive
+	std::array<SDL2pp::Rect, FS::max_channels> spectrum_rects(int count);
+
+	// number of spectra drawn per frame for the current channel mode
+	int spectrum_count() const;
+
+	// number of channels the FFT engine transforms per frame for the current channel mode
+	int analysis_channels() const;
+
+	// records `analysis_channels` in the analysis options, after a channel mode change
+	void update_analysis_channels();
+
+	// number of bars per spectrum for the current output size and channel mode
+	int spectrum_bars();
+
+	// fills `frame` from `audio_buffer`, whose first `hop` frames are new since the previous call; touches no SDL state
+	void analyze(SpectrumFrame &frame, int bars, int hop);
+
+	// first half of `analyze` with the `FFT` engine: transforms the analyzed channels of `audio_buffer`
+	void transform_audio();
+
+	// second half of `analyze`: fills `frame` from the bins of `source`'s last `transform_audio`, or with the `BIQUAD`
+	// engine from `source`'s audio buffer. `source` may be another visualizer of the same audio and analysis options
+	void bin(const Visualizer &source, SpectrumFrame &frame, int bars, int hop);
+
+	// draws and encodes the frames of `encode_to_video` and `encode_renditions`, see `Visualizer.cpp`
+	class VideoEncoder;
+
+	// creates the biquad filter banks for the current analysis options, if using the `BIQUAD` engine
+	void reset_biquads();
+
+	// linearly interpolates between `a` (`t = 0`) and `b` (`t = 1`) into `out`
+	static void blend(const SpectrumFrame &a, const SpectrumFrame &b, float t, SpectrumFrame &out);
+
+	// draws one video frame: background, `frame`'s spectra and metadata
+	void draw(const SpectrumFrame &frame);
+
+	// draws one video frame into `pixels` on the CPU: `frame`'s spectra between `target`'s layers
+	void draw(const SpectrumFrame &frame, FrameRasterizer &target, uint32_t *pixels);
+
+	// draws what lies under and over the spectra, respectively
+	void draw_background();
+	void draw_metadata();
+
+	// height taken by the waveform strips at the bottom of the output
+	int waveform_band_height() const;
+
+	// draws the waveform strips around sample `center`, through SDL or into `target`
+	void draw_waveforms(long center, FrameRasterizer *target = nullptr);
+
+	// reads ahead with `waveform_sf` until `peaks` covers `samples` samples or the audio ends
+	void extend_peaks(long samples);
+
+	// plots `frame`'s audio into the vectorscope and draws it through SDL, or into `pixels` once `target` is rendered
+	void draw_vectorscope(const SpectrumFrame &frame, uint32_t *pixels = nullptr);
+
+	// draws the background and metadata through the renderer once, as `target`'s layers
+	void render_static_layers(FrameRasterizer &target);
+
+	// `hop`: samples played per analysis, the smallest sample size keys can pick
+	void handle_events(int hop);
+
+	// live controls: up/down double/halve the sample size, `s`, `w` and `a` cycle the scale, window function and
+	// accumulation method. changes are committed right away and swapped in once built
+	void handle_key(SDL_Keycode key, int hop);
 	SDL2pp::Rect bg_texture_centered_max_width();
 };
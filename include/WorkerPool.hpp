@@ -0,0 +1,54 @@
+#pragma once
+
+#include <barrier>
+#include <exception>
+#include <functional>
+#include <thread>
+#include <vector>
+
+/**
+ * Fixed set of threads that run one job in parallel, once per `run`, such as converting or rendering a frame in bands.
+ * Job `0` runs on the thread calling `run`, and jobs `1..size() - 1` on the pool's own threads, which wait on barriers
+ * in between so that no thread is started per call.
+ */
+class WorkerPool
+{
+	const int threads;
+	const std::function<void(int)> job;
+
+	// exceptions thrown by each job during the current `run`
+	std::vector<std::exception_ptr> errors;
+
+	// whether the workers should exit; published to them through `start`
+	bool stopping = false;
+	std::barrier<> start, done;
+
+	// declared last so that they are joined before anything they use is destroyed
+	std::vector<std::jthread> workers;
+
+	void run_job(int index);
+
+public:
+	/**
+	 * @param threads number of jobs run in parallel, counting the thread calling `run`
+	 * @param job called with each index in `[0, threads)` on every `run`
+	 * @throws `std::invalid_argument` if `threads` is not positive
+	 */
+	WorkerPool(int threads, std::function<void(int)> job);
+	/**
+	 * Stops and joins the workers; safe while unwinding from an exception thrown between `run`s.
+	 */
+	~WorkerPool();
+
+	WorkerPool(const WorkerPool &) = delete;
+	WorkerPool &operator=(const WorkerPool &) = delete;
+
+	int size() const { return threads; }
+
+	/**
+	 * Runs every job and returns once all of them are done. Writes made before the call are visible to the jobs,
+	 * and the jobs' writes are visible after it.
+	 * @throws the first exception thrown by a job, by index, once all jobs are done
+	 */
+	void run();
+};
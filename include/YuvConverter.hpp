@@ -0,0 +1,75 @@
+#pragma once
+
+#include "WorkerPool.hpp"
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Converts rendered frames to 4:2:0 YUV (BT.601, limited range, as `ffmpeg` assumes for untagged input) before they
+ * reach the encoder, so that half the bytes cross the pipe and the encoder's own conversion is skipped.
+ * Each frame is split into bands of row pairs, one per thread; the per-pixel math is plain fixed-point integer
+ * arithmetic over row spans, which the compiler vectorizes. Odd widths and heights repeat the last column and row
+ * into the last chroma sample, matching the plane sizes `ffmpeg` expects.
+ */
+class YuvConverter
+{
+public:
+	enum class InputFormat
+	{
+		// ARGB8888 words, as drawn by `FrameRasterizer`
+		BGRA,
+		RGB24
+	};
+
+	enum class OutputFormat
+	{
+		// planar Y, U and V
+		YUV420P,
+		// planar Y, then U and V interleaved
+		NV12
+	};
+
+private:
+	const int width, height, chroma_width, chroma_height;
+	const InputFormat input_format;
+	const OutputFormat output_format;
+	const int bands;
+
+	// frame being converted, published to the bands by `pool.run`
+	const void *source = nullptr;
+	uint8_t *planes[3]{};
+	int strides[3]{};
+
+	// declared last so that its threads are joined before anything they use is destroyed
+	WorkerPool pool;
+
+	void convert_band(int band);
+	// converts the two rows of pixels under one row of chroma
+	void convert_row_pair(int chroma_row);
+
+public:
+	/**
+	 * @param threads number of bands converted in parallel, counting the thread calling `convert`
+	 * @throws `std::invalid_argument` if `width`, `height` or `threads` is not positive
+	 */
+	YuvConverter(int width, int height, InputFormat input_format, OutputFormat output_format, int threads);
+
+	/**
+	 * @returns size in bytes of a packed frame of either output format
+	 */
+	static size_t frame_size(int width, int height);
+
+	/**
+	 * Converts one frame into packed planes, as sent through a pipe.
+	 * @param pixels `width * height` pixels in the input format, rows packed
+	 * @param frame `frame_size(width, height)` bytes
+	 */
+	void convert(const void *pixels, uint8_t *frame);
+
+	/**
+	 * Converts one frame into planes with arbitrary strides, such as an encoder's frame buffers.
+	 * @param planes Y, U and V planes; for `NV12`, Y and UV, with the third ignored
+	 * @param strides bytes between rows of each plane
+	 */
+	void convert(const void *pixels, uint8_t *const planes[3], const int strides[3]);
+};
@@ -1,32 +1,56 @@
 #pragma once
 
+#include <mutex>
 #include <stdexcept>
 #include <fftw3.h>
 
 class fftwf_dft_r2c_1d
 {
-	int N;
+	// only fftw's execute functions are thread safe; planning must be serialized
+	inline static std::mutex planner_mutex;
+
+	int N, howmany, threads;
+	// distance between consecutive transforms' buffers, padded to 64 bytes so they all share the first one's alignment
+	int idist, odist;
 	float *in;
 	fftwf_complex *out;
 	fftwf_plan p;
 
-	void init(const int N)
+	void init(const int N, const int howmany, const int threads)
 	{
 		this->N = N;
-		in = (float *)fftwf_malloc(sizeof(float) * N);
-		out = (fftwf_complex *)fftwf_malloc(sizeof(fftwf_complex) * output_size());
-		p = fftwf_plan_dft_r2c_1d(N, in, out, FFTW_ESTIMATE);
+		this->howmany = howmany;
+		this->threads = threads;
+		idist = (N + 15) / 16 * 16;
+		odist = (output_size() + 7) / 8 * 8;
+
+		const std::lock_guard lock(planner_mutex);
+		// must come before any other fftw call; if it fails, plans just stay single-threaded
+		static const bool threads_available = fftwf_init_threads();
+		in = (float *)fftwf_malloc(sizeof(float) * idist * howmany);
+		out = (fftwf_complex *)fftwf_malloc(sizeof(fftwf_complex) * odist * howmany);
+		fftwf_plan_with_nthreads(threads_available ? threads : 1);
+		p = howmany == 1 ? fftwf_plan_dft_r2c_1d(N, in, out, FFTW_ESTIMATE)
+						 : fftwf_plan_many_dft_r2c(1, &N, howmany, in, nullptr, 1, idist, out, nullptr, 1, odist, FFTW_ESTIMATE);
 	}
 
 	void cleanup()
 	{
-		fftwf_destroy_plan(p);
+		{
+			const std::lock_guard lock(planner_mutex);
+			fftwf_destroy_plan(p);
+		}
 		fftwf_free(in);
 		fftwf_free(out);
 	}
 
 public:
-	fftwf_dft_r2c_1d(const int N) { init(N); }
+	/**
+	 * @param N size of each transform
+	 * @param howmany number of transforms of size `N` done by each `execute`, each with its own input and output
+	 * @param threads number of threads fftw may split the work between
+	 */
+	fftwf_dft_r2c_1d(const int N, const int howmany = 1, const int threads = 1) { init(N, howmany, threads); }
 	~fftwf_dft_r2c_1d() { cleanup(); }
 
 	void set_n(const int N)
@@ -35,12 +59,13 @@ public:
 			throw std::invalid_argument("N is zero");
 		if (this->N == N) return;
 		cleanup();
-		init(N);
+		init(N, howmany, threads);
 	}
 
 	void execute() { fftwf_execute(p); }
-	float *input() { return in; }
-	const fftwf_complex *output() const { return out; }
+	float *input(const int k = 0) { return in + k * idist; }
+	const fftwf_complex *output(const int k = 0) const { return out + k * odist; }
 	int input_size() const { return N; }
 	int output_size() const { return N / 2 + 1; }
+	int transforms() const { return howmany; }
 };
\ No newline at end of file
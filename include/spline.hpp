@@ -50,6 +50,57 @@ namespace
 namespace tk
 {
 
+namespace internal
+{
+
+// band matrix solver
+class band_matrix
+{
+private:
+    std::vector< std::vector<double> > m_upper;  // upper band
+    std::vector< std::vector<double> > m_lower;  // lower band
+public:
+    band_matrix() {};                             // constructor
+    band_matrix(int dim, int n_u, int n_l);       // constructor
+    ~band_matrix() {};                            // destructor
+    void resize(int dim, int n_u, int n_l);      // init with dim,n_u,n_l
+    void reserve(int dim, int n_u, int n_l);     // preallocate storage
+    int dim() const;                             // matrix dimension
+    int num_upper() const
+    {
+        return (int)m_upper.size()-1;
+    }
+    int num_lower() const
+    {
+        return (int)m_lower.size()-1;
+    }
+    // access operator
+    double & operator () (int i, int j);            // write
+    double   operator () (int i, int j) const;      // read
+    // we can store an additional diagonal (in m_lower)
+    double& saved_diag(int i);
+    double  saved_diag(int i) const;
+    void lu_decompose();
+    std::vector<double> r_solve(const std::vector<double>& b) const;
+    std::vector<double> l_solve(const std::vector<double>& b) const;
+    std::vector<double> lu_solve(const std::vector<double>& b,
+                                 bool is_lu_decomposed=false);
+    // non-allocating variants writing into caller-owned vectors
+    void r_solve(const std::vector<double>& b, std::vector<double>& x) const;
+    void l_solve(const std::vector<double>& b, std::vector<double>& x) const;
+    void lu_solve(const std::vector<double>& b, std::vector<double>& x,
+                  std::vector<double>& tmp, bool is_lu_decomposed=false);
+
+};
+
+double get_eps();
+
+std::vector<double> solve_cubic(double a, double b, double c, double d,
+                                int newton_iter=0);
+
+} // namespace internal
+
+
 // spline interpolation
 class spline
 {
@@ -79,6 +130,9 @@ protected:
     bd_type m_left, m_right;
     double  m_left_value, m_right_value;
     bool m_made_monotonic;
+    // scratch space for set_points(), kept to avoid per-call allocations
+    internal::band_matrix m_band;
+    std::vector<double> m_rhs, m_tmp;
     void set_coeffs_from_b();               // calculate c_i, d_i from b_i
     size_t find_closest(double x) const;    // closest idx so that m_x[idx]<=x
 
@@ -113,6 +167,10 @@ public:
     void set_boundary(bd_type left, double left_value,
                       bd_type right, double right_value);
 
+    // preallocate storage for up to n data points, so that subsequent
+    // calls to set_points() with at most n points do not allocate
+    void reserve(int n);
+
     // set all data points (cubic_spline=false means linear interpolation)
     void set_points(const std::vector<double>& x,
                     const std::vector<double>& y,
@@ -149,49 +207,6 @@ public:
 
 
 
-namespace internal
-{
-
-// band matrix solver
-class band_matrix
-{
-private:
-    std::vector< std::vector<double> > m_upper;  // upper band
-    std::vector< std::vector<double> > m_lower;  // lower band
-public:
-    band_matrix() {};                             // constructor
-    band_matrix(int dim, int n_u, int n_l);       // constructor
-    ~band_matrix() {};                            // destructor
-    void resize(int dim, int n_u, int n_l);      // init with dim,n_u,n_l
-    int dim() const;                             // matrix dimension
-    int num_upper() const
-    {
-        return (int)m_upper.size()-1;
-    }
-    int num_lower() const
-    {
-        return (int)m_lower.size()-1;
-    }
-    // access operator
-    double & operator () (int i, int j);            // write
-    double   operator () (int i, int j) const;      // read
-    // we can store an additional diagonal (in m_lower)
-    double& saved_diag(int i);
-    double  saved_diag(int i) const;
-    void lu_decompose();
-    std::vector<double> r_solve(const std::vector<double>& b) const;
-    std::vector<double> l_solve(const std::vector<double>& b) const;
-    std::vector<double> lu_solve(const std::vector<double>& b,
-                                 bool is_lu_decomposed=false);
-
-};
-
-double get_eps();
-
-std::vector<double> solve_cubic(double a, double b, double c, double d,
-                                int newton_iter=0);
-
-} // namespace internal
 
 
 
@@ -214,6 +229,18 @@ void spline::set_boundary(spline::bd_type left, double left_value,
 }
 
 
+void spline::reserve(int n)
+{
+    m_x.reserve(n);
+    m_y.reserve(n);
+    m_b.reserve(n);
+    m_c.reserve(n);
+    m_d.reserve(n);
+    m_rhs.reserve(n);
+    m_tmp.reserve(n);
+    m_band.reserve(n,2,2);
+}
+
 void spline::set_coeffs_from_b()
 {
     assert(m_x.size()==m_y.size());
@@ -279,8 +306,10 @@ void spline::set_points(const std::vector<double>& x,
         // for the parameters b[]
         int n_upper = (m_left  == spline::not_a_knot) ? 2 : 1;
         int n_lower = (m_right == spline::not_a_knot) ? 2 : 1;
-        internal::band_matrix A(n,n_upper,n_lower);
-        std::vector<double>  rhs(n);
+        internal::band_matrix& A = m_band;
+        A.resize(n,n_upper,n_lower);
+        std::vector<double>& rhs = m_rhs;
+        rhs.assign(n,0.0);
         for(int i=1; i<n-1; i++) {
             A(i,i-1)=1.0/3.0*(x[i]-x[i-1]);
             A(i,i)=2.0/3.0*(x[i+1]-x[i-1]);
@@ -333,7 +362,7 @@ void spline::set_points(const std::vector<double>& x,
         }
 
         // solve the equation system to obtain the parameters c[]
-        m_c=A.lu_solve(rhs);
+        A.lu_solve(rhs,m_c,m_tmp);
 
         // calculate parameters b[] and d[] based on c[]
         m_d.resize(n);
@@ -630,11 +659,23 @@ void band_matrix::resize(int dim, int n_u, int n_l)
     assert(n_l>=0);
     m_upper.resize(n_u+1);
     m_lower.resize(n_l+1);
+    // assign() rather than resize() so that reused storage starts zeroed
+    for(size_t i=0; i<m_upper.size(); i++) {
+        m_upper[i].assign(dim,0.0);
+    }
+    for(size_t i=0; i<m_lower.size(); i++) {
+        m_lower[i].assign(dim,0.0);
+    }
+}
+void band_matrix::reserve(int dim, int n_u, int n_l)
+{
+    if((int)m_upper.size()<n_u+1) m_upper.resize(n_u+1);
+    if((int)m_lower.size()<n_l+1) m_lower.resize(n_l+1);
     for(size_t i=0; i<m_upper.size(); i++) {
-        m_upper[i].resize(dim);
+        m_upper[i].reserve(dim);
     }
     for(size_t i=0; i<m_lower.size(); i++) {
-        m_lower[i].resize(dim);
+        m_lower[i].reserve(dim);
     }
 }
 int band_matrix::dim() const
@@ -716,9 +757,15 @@ void band_matrix::lu_decompose()
 }
 // solves Ly=b
 std::vector<double> band_matrix::l_solve(const std::vector<double>& b) const
+{
+    std::vector<double> x;
+    l_solve(b,x);
+    return x;
+}
+void band_matrix::l_solve(const std::vector<double>& b, std::vector<double>& x) const
 {
     assert( this->dim()==(int)b.size() );
-    std::vector<double> x(this->dim());
+    x.resize(this->dim());
     int j_start;
     double sum;
     for(int i=0; i<this->dim(); i++) {
@@ -727,13 +774,18 @@ std::vector<double> band_matrix::l_solve(const std::vector<double>& b) const
         for(int j=j_start; j<i; j++) sum += this->operator()(i,j)*x[j];
         x[i]=(b[i]*this->saved_diag(i)) - sum;
     }
-    return x;
 }
 // solves Rx=y
 std::vector<double> band_matrix::r_solve(const std::vector<double>& b) const
+{
+    std::vector<double> x;
+    r_solve(b,x);
+    return x;
+}
+void band_matrix::r_solve(const std::vector<double>& b, std::vector<double>& x) const
 {
     assert( this->dim()==(int)b.size() );
-    std::vector<double> x(this->dim());
+    x.resize(this->dim());
     int j_stop;
     double sum;
     for(int i=this->dim()-1; i>=0; i--) {
@@ -742,7 +794,6 @@ std::vector<double> band_matrix::r_solve(const std::vector<double>& b) const
         for(int j=i+1; j<=j_stop; j++) sum += this->operator()(i,j)*x[j];
         x[i]=( b[i] - sum ) / this->operator()(i,i);
     }
-    return x;
 }
 
 std::vector<double> band_matrix::lu_solve(const std::vector<double>& b,
@@ -757,6 +808,16 @@ std::vector<double> band_matrix::lu_solve(const std::vector<double>& b,
     x=this->r_solve(y);
     return x;
 }
+void band_matrix::lu_solve(const std::vector<double>& b, std::vector<double>& x,
+                           std::vector<double>& tmp, bool is_lu_decomposed)
+{
+    assert( this->dim()==(int)b.size() );
+    if(is_lu_decomposed==false) {
+        this->lu_decompose();
+    }
+    this->l_solve(b,tmp);
+    this->r_solve(tmp,x);
+}
 
 // machine precision of a double, i.e. the successor of 1 is 1+eps
 double get_eps()
@@ -0,0 +1,66 @@
+#ifdef AUDIOVIZ_ALLOC_GUARD
+
+#include "AllocGuard.hpp"
+#include <cstdlib>
+#include <new>
+
+// per thread, so that concurrent jobs or worker threads don't trip each other's guards
+static thread_local size_t allocations;
+
+size_t AllocGuard::count()
+{
+	return allocations;
+}
+
+static void *counted_alloc(const size_t size, const size_t alignment = 0)
+{
+	++allocations;
+	// aligned_alloc requires the size to be a multiple of the alignment
+	return alignment ? aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment)
+					 : malloc(size ? size : 1);
+}
+
+void *operator new(const size_t size)
+{
+	if (const auto p = counted_alloc(size))
+		return p;
+	throw std::bad_alloc();
+}
+
+void *operator new[](const size_t size)
+{
+	return operator new(size);
+}
+
+void *operator new(const size_t size, const std::align_val_t al)
+{
+	if (const auto p = counted_alloc(size, (size_t)al))
+		return p;
+	throw std::bad_alloc();
+}
+
+void *operator new[](const size_t size, const std::align_val_t al)
+{
+	return operator new(size, al);
+}
+
+void *operator new(const size_t size, const std::nothrow_t &) noexcept
+{
+	return counted_alloc(size);
+}
+
+void *operator new[](const size_t size, const std::nothrow_t &) noexcept
+{
+	return counted_alloc(size);
+}
+
+void operator delete(void *const p) noexcept { free(p); }
+void operator delete[](void *const p) noexcept { free(p); }
+void operator delete(void *const p, size_t) noexcept { free(p); }
+void operator delete[](void *const p, size_t) noexcept { free(p); }
+void operator delete(void *const p, std::align_val_t) noexcept { free(p); }
+void operator delete[](void *const p, std::align_val_t) noexcept { free(p); }
+void operator delete(void *const p, size_t, std::align_val_t) noexcept { free(p); }
+void operator delete[](void *const p, size_t, std::align_val_t) noexcept { free(p); }
+
+#endif
@@ -1,11 +1,25 @@
 #include "Args.hpp"
 #include <SDL_types.h>
+#include <thread>
 
-Args::Args(const int argc, const char *const *const argv)
+Args::Args(const int argc, const char *const *const argv, const bool exit_on_error)
 	: ArgumentParser(argv[0])
 {
 	add_argument("audio_file")
-		.help("audio file to visualize and play");
+		.help("audio file to visualize and play\nrequired unless '--batch' is used")
+		.nargs(0, 1)
+		.default_value("");
+
+	add_argument("--batch")
+		.help("encode every job listed in a manifest file, reusing fonts and images across jobs\n"
+			  "each non-empty line not starting with '#' is one job: the arguments you would pass to audioviz,\n"
+			  "and must include '--encode', '--renditions' or '--dump'. jobs render headless, so no display is needed")
+		.validate();
+	add_argument("-j", "--jobs")
+		.help("requires '--batch' or '--segments'\nmaximum number of jobs or segments to run at once, at least 1\ndefaults to the number of CPU threads")
+		.default_value(std::max(1u, std::thread::hardware_concurrency()))
+		.scan<'u', uint>()
+		.validate();
 
 	add_argument("--encode")
 		.help("encode to a video using ffmpeg! arguments: <output_file> <fps> [vcodec] [acodec]")
@@ -13,13 +27,103 @@ Args::Args(const int argc, const char *const *const argv)
 		.validate();
 	add_argument("--ffmpeg-path")
 		.help("specify ffmpeg path used with '--encode'");
+	add_argument("--segments")
+		.help("requires '--encode'\nsplit the video into this many segments, each encoded by its own process ('-j' at once),\n"
+			  "then concatenated without re-encoding. finished segments are recorded next to the output,\n"
+			  "so running the same command again after a crash only encodes the missing ones")
+		.scan<'u', uint>()
+		.validate();
+	add_argument("--segment")
+		.help("internal: encode only segment <index> of <count>, as a worker of '--segments'")
+		.nargs(2)
+		.scan<'u', uint>()
+		.validate();
+	add_argument("--renditions")
+		.help("encode several videos from one pass over the audio, each spec being\n"
+			  "<width>x<height>,<fps>,<output_file>[,vcodec[,acodec]]. the audio is read and analyzed once,\n"
+			  "then every rendition draws and encodes on its own thread. takes the same options as '--encode'")
+		.nargs(1, 8)
+		.validate();
+	add_argument("--encoder")
+		.help("requires '--encode'\n- 'ffmpeg': frames piped to an ffmpeg subprocess\n- 'libav': encoded in-process with libavcodec, no pipe (requires building with 'make libav=1')")
+		.default_value("ffmpeg");
+	add_argument("--rasterizer")
+		.help("requires '--encode'\n- 'cpu': bars drawn on the CPU straight into the video frames, no readback\n- 'sdl': the same renderer as the window, each frame read back while the next is drawn")
+		.default_value("cpu");
+	add_argument("--raster-threads")
+		.help("requires '--encode'\nthreads to split each frame's cpu rasterizing and yuv conversion between\n0 means one per CPU thread, shared between '--renditions', or one per job with '--batch'")
+		.default_value(0u)
+		.scan<'u', uint>()
+		.validate();
+	add_argument("--pix-fmt")
+		.help("requires '--encode'\npixel format of the frames handed to the encoder\n- 'yuv420p': converted on our side across '--raster-threads' threads, 1.5 bytes per pixel\n- 'nv12': the same, with interleaved chroma\n- 'rgb': as drawn, 3 or 4 bytes per pixel, leaving conversion to the encoder")
+		.default_value("yuv420p");
+
+	add_argument("--dump")
+		.help("analysis only: write the spectrum of every frame to a file ('-' for stdout) instead of rendering\nno window is opened, and it runs as fast as possible");
+	add_argument("--dump-format")
+		.help("requires '--dump'\n- 'raw': small header followed by frames (see SpectrumDumper.hpp)\n- 'npy': numpy array of shape (frames, channels, bars)\ndefaults to 'npy' if the output file ends in '.npy', otherwise 'raw'");
+	add_argument("--dump-type")
+		.help("requires '--dump'\n- 'f32': raw float32 amplitudes\n- 'u16': amplitudes times '-m', clamped to [0, 1] and quantized to uint16")
+		.default_value("f32");
+	add_argument("--dump-fps")
+		.help("requires '--dump'\nnumber of frames to analyze per second of audio")
+		.default_value(60u)
+		.scan<'u', uint>()
+		.validate();
+	add_argument("--bars")
+		.help("requires '--dump'\nnumber of spectrum bars per channel")
+		.default_value(64u)
+		.scan<'u', uint>()
+		.validate();
+
+	add_argument("--engine")
+		.help("analysis engine\n- 'fft': FFT over the last '-n' samples\n- 'biquad': band-pass filter per bar on the newest samples, reacts within milliseconds\nonly '-s' applies to 'biquad', and '--encode' ignores '--analysis-rate' with it")
+		.default_value("fft");
+
+	add_argument("--analysis-rate")
+		.help("spectra to analyze per second of audio, independent of the frame rate\neach frame blends the two nearest spectra, which saves FFT work on high refresh rate displays\n0 analyzes once per frame; otherwise from samplerate / '-n' to samplerate")
+		.default_value(0u)
+		.scan<'u', uint>()
+		.validate();
 
 	add_argument("--mono")
-		.help("force a mono spectrum even if audio is stereo\nmust specify zero-indexed channel number to render\nnegative values disable this flag")
+		.help("force a mono spectrum even if audio is stereo or surround\nmust specify zero-indexed channel number to render\nnegative values disable this flag")
 		.default_value(-1)
 		.scan<'i', int>()
 		.validate();
 
+	add_argument("--layout")
+		.help("arrangement of multiple spectra, such as the channels of surround audio\n- 'grid': as square as possible; stereo is mirrored from the center\n- 'stacked': one full-width row per spectrum\n- 'radial': around a circle with the album art inside; stereo is mirrored from the top")
+		.default_value("grid");
+
+	add_argument("--views")
+		.help("stereo audio only: draw (or with '--dump', dump) views derived from the left and right channels instead of the channels themselves\n"
+			  "'l', 'r', 'm' (mid, the mono downmix), 's' (side); at most two when drawing\neach channel is still transformed once, however many views are derived from it")
+		.nargs(1, 8);
+
+	add_argument("--spectrogram")
+		.help("draw a waterfall of past spectra scrolling up under the bars, colored like them\nwith '--encode', implies '--rasterizer sdl'")
+		.default_value(false)
+		.implicit_value(true);
+
+	add_argument("--waveform")
+		.help("draw waveform strips under the spectra, one per zoom level\nseconds of audio across each strip, around the current frame, e.g. '0.05 1 10'")
+		.nargs(1, 4)
+		.scan<'f', float>()
+		.validate();
+
+	add_argument("--vectorscope")
+		.help("draw a stereo phase scope of this size in pixels in the top right corner\nevery sample of each frame's analysis window is plotted, side across and mid up")
+		.scan<'u', uint>()
+		.validate();
+
+	add_argument("--scope-persistence")
+		.help("requires '--vectorscope'\nfraction of the scope's brightness kept from one frame to the next, in [0, 1)")
+		.default_value(0.8f)
+		.scan<'f', float>()
+		.validate();
+
 	add_argument("--bg")
 		.help("add a background image; path to image file required");
 
@@ -43,8 +147,14 @@ Args::Args(const int argc, const char *const *const argv)
 		.nargs(1, 2)
 		.default_value(std::vector<std::string>{"log"});
 
+	add_argument("--multires")
+		.help("multi-resolution analysis with this many bands, from 1 to 3\neach extra band analyzes the bass on a signal decimated by 4,\nso '-n' sets the bass resolution while treble uses a window 4x shorter per extra band\n'-n' must be a multiple of 4^(bands - 1)")
+		.default_value(1u)
+		.scan<'u', uint>()
+		.validate();
+
 	add_argument("-a", "--accum-method")
-		.help("frequency bin accumulation method\n- 'sum': greater treble detail, exaggerated amplitude\n- 'max': less treble detail, true-to-waveform amplitude")
+		.help("frequency bin accumulation method\n- 'sum': greater treble detail, exaggerated amplitude\n- 'max': less treble detail, true-to-waveform amplitude\n- 'filterbank': overlapping triangular filters, smooth without interpolation")
 		.default_value("max");
 
 	add_argument("-w", "--window-func")
@@ -113,6 +223,9 @@ Args::Args(const int argc, const char *const *const argv)
 	}
 	catch (const std::exception &e)
 	{
+		if (!exit_on_error)
+			throw;
+
 		// print error and help to stderr
 		std::cerr << argv[0] << ": " << e.what() << '\n'
 				  << *this;
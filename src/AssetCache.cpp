@@ -0,0 +1,24 @@
+#include "AssetCache.hpp"
+#include <SDL2pp/SDLTTF.hh>
+
+SDL2pp::Texture AssetCache::text(SDL2pp::Renderer &renderer, const std::string &font_path, const int size, const int style, const std::string &text, const SDL2pp::Color color)
+{
+	// fonts are not safe to render with from multiple threads, so render under the lock too
+	const std::lock_guard lock(mutex);
+	auto it = fonts.find({font_path, size, style});
+	if (it == fonts.end())
+	{
+		it = fonts.emplace(std::tuple{font_path, size, style}, SDL2pp::Font(font_path, size)).first;
+		it->second.SetStyle(style);
+	}
+	return SDL2pp::Texture(renderer, it->second.RenderUTF8_Blended(text, color));
+}
+
+SDL2pp::Texture AssetCache::image(SDL2pp::Renderer &renderer, const std::string &path)
+{
+	const std::lock_guard lock(mutex);
+	auto it = images.find(path);
+	if (it == images.end())
+		it = images.emplace(path, SDL2pp::Surface(path)).first;
+	return SDL2pp::Texture(renderer, it->second);
+}
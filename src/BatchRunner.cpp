@@ -0,0 +1,122 @@
+#include "BatchRunner.hpp"
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+// splits a manifest line into arguments, honoring '' and "" quotes
+static BatchRunner::Job split_args(const std::string &line, const int line_number)
+{
+	BatchRunner::Job args;
+	std::string arg;
+	bool in_arg = false;
+	char quote = 0;
+
+	for (const char c : line)
+	{
+		if (quote)
+		{
+			if (c == quote)
+				quote = 0;
+			else
+				arg += c;
+		}
+		else if (c == '\'' || c == '"')
+			quote = c, in_arg = true;
+		else if (isspace(c))
+		{
+			if (in_arg)
+				args.emplace_back(std::move(arg)), arg.clear();
+			in_arg = false;
+		}
+		else
+			arg += c, in_arg = true;
+	}
+
+	if (quote)
+		throw std::runtime_error("manifest line " + std::to_string(line_number) + ": unterminated quote");
+	if (in_arg)
+		args.emplace_back(std::move(arg));
+	return args;
+}
+
+BatchRunner::BatchRunner(const std::string &manifest)
+{
+	std::ifstream in(manifest);
+	if (!in)
+		throw std::runtime_error("cannot open manifest: " + manifest);
+
+	std::string line;
+	for (int line_number = 1; std::getline(in, line); ++line_number)
+	{
+		const auto start = line.find_first_not_of(" \t\r");
+		if (start == std::string::npos || line[start] == '#')
+			continue;
+		jobs.push_back({line_number, split_args(line, line_number)});
+	}
+}
+
+int BatchRunner::run(const int concurrency, const std::function<void(const Job &)> &run_job)
+{
+	if (concurrency <= 0)
+		throw std::invalid_argument("BatchRunner::run: concurrency must be positive");
+
+	using clock = std::chrono::steady_clock;
+	const auto batch_start = clock::now();
+
+	std::atomic<size_t> next_job = 0;
+	std::atomic<int> failed = 0;
+	std::mutex print_mutex;
+
+	const auto describe = [&](const size_t i)
+	{
+		std::ostringstream desc;
+		desc << '[' << i + 1 << '/' << jobs.size() << "] line " << jobs[i].line << ':';
+		for (const auto &arg : jobs[i].args)
+			desc << ' ' << arg;
+		return desc.str();
+	};
+
+	const auto worker = [&]
+	{
+		for (size_t i; (i = next_job++) < jobs.size();)
+		{
+			{
+				const std::lock_guard lock(print_mutex);
+				std::cerr << describe(i) << ": started\n";
+			}
+
+			const auto start = clock::now();
+			std::string error;
+			try
+			{
+				run_job(jobs[i].args);
+			}
+			catch (const std::exception &e)
+			{
+				error = e.what();
+				++failed;
+			}
+			const std::chrono::duration<double> elapsed = clock::now() - start;
+
+			const std::lock_guard lock(print_mutex);
+			if (error.empty())
+				std::cerr << describe(i) << ": done in " << elapsed.count() << " s\n";
+			else
+				std::cerr << describe(i) << ": FAILED after " << elapsed.count() << " s: " << error << '\n';
+		}
+	};
+
+	std::vector<std::jthread> threads;
+	for (int i = 0; i < std::min<int>(concurrency, jobs.size()); ++i)
+		threads.emplace_back(worker);
+	threads.clear();
+
+	const std::chrono::duration<double> elapsed = clock::now() - batch_start;
+	std::cerr << "batch: " << jobs.size() - failed << " succeeded, " << failed << " failed in " << elapsed.count() << " s\n";
+	return failed;
+}
@@ -0,0 +1,98 @@
+#include "BiquadSpectrum.hpp"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+// `FrequencySpectrum` reads a sine of amplitude A at A/2 times the Blackman window's coherent gain of 0.42
+static const float gain = 0.21f;
+
+// added to the input so that the filters' state never decays into denormals on silence; band-passes reject it
+static const float anti_denormal = 1e-18f;
+
+BiquadSpectrum::BiquadSpectrum(const int samplerate)
+	: samplerate(samplerate)
+{
+	if (samplerate <= 0)
+		throw std::invalid_argument("BiquadSpectrum: samplerate must be positive");
+}
+
+float BiquadSpectrum::frequency(const float x, const int bands) const
+{
+	const float nyquist = samplerate / 2.f, r = x / bands;
+	float f;
+	switch (scale)
+	{
+	case FS::Scale::LINEAR:
+		f = r * nyquist;
+		break;
+	case FS::Scale::LOG:
+		f = min_frequency * pow(nyquist / min_frequency, r);
+		break;
+	case FS::Scale::NTH_ROOT:
+		f = pow(r, nth_root) * nyquist;
+		break;
+	default:
+		throw std::logic_error("BiquadSpectrum::frequency: default case hit");
+	}
+	// keep clear of dc and nyquist, where the filter design breaks down
+	return std::clamp(f, 1.f, 0.49f * samplerate);
+}
+
+void BiquadSpectrum::reset(const int bands)
+{
+	designed_scale = scale;
+	designed_nth_root = nth_root;
+	for (auto v : {&b0, &a1, &a2, &z1, &z2, &release, &envelope})
+		v->assign(bands, 0);
+
+	for (int j = 0; j < bands; ++j)
+	{
+		// each band spans the distance between its edges on the scale
+		const auto lo = frequency(j, bands), center = frequency(j + 0.5f, bands), hi = frequency(j + 1, bands);
+		const auto q = std::clamp(center / std::max(hi - lo, 1e-3f), 0.5f, max_q);
+
+		// RBJ band-pass with 0 dB peak gain
+		const auto w0 = 2 * M_PI * center / samplerate;
+		const auto alpha = sin(w0) / (2 * q);
+		const auto a0 = 1 + alpha;
+		b0[j] = alpha / a0;
+		a1[j] = -2 * cos(w0) / a0;
+		a2[j] = (1 - alpha) / a0;
+
+		release[j] = exp(-1 / (std::max(release_time, 2 / center) * samplerate));
+	}
+}
+
+void BiquadSpectrum::process(const float *const audio, const int frames, const int num_channels, const int channel)
+{
+	if (channel < 0 || channel >= num_channels)
+		throw std::invalid_argument("BiquadSpectrum::process: channel must be in [0, num_channels)");
+	if (scale != designed_scale || nth_root != designed_nth_root)
+		reset(b0.size());
+
+	const int n = b0.size();
+	// restrict: lets the compiler vectorize across bands without checking for aliasing
+	float *__restrict const z1 = this->z1.data(), *__restrict const z2 = this->z2.data(), *__restrict const env = envelope.data();
+	const float *__restrict const b0 = this->b0.data(), *__restrict const a1 = this->a1.data(), *__restrict const a2 = this->a2.data(), *__restrict const release = this->release.data();
+
+	// one sample at a time across all bands: each band's recursion is serial, but the bands are independent
+	for (int i = 0; i < frames; ++i)
+	{
+		const auto x = audio[i * num_channels + channel] + anti_denormal;
+		for (int j = 0; j < n; ++j)
+		{
+			const auto y = b0[j] * x + z1[j];
+			z1[j] = z2[j] - a1[j] * y;
+			z2[j] = -b0[j] * x - a2[j] * y;
+			env[j] = std::max(std::abs(y), env[j] * release[j]);
+		}
+	}
+}
+
+void BiquadSpectrum::render(std::vector<float> &spectrum)
+{
+	if (spectrum.size() != b0.size())
+		reset(spectrum.size());
+	for (size_t j = 0; j < spectrum.size(); ++j)
+		spectrum[j] = gain * envelope[j];
+}
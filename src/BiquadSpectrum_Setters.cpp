@@ -0,0 +1,14 @@
+#include "BiquadSpectrum.hpp"
+#include <stdexcept>
+
+void BiquadSpectrum::set_scale(const FS::Scale scale)
+{
+	this->scale = scale;
+}
+
+void BiquadSpectrum::set_nth_root(const int nth_root)
+{
+	if (!nth_root)
+		throw std::invalid_argument("BiquadSpectrum::set_nth_root: nth_root cannot be zero");
+	this->nth_root = nth_root;
+}
@@ -0,0 +1,180 @@
+#include "FrameRasterizer.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+static constexpr uint32_t opaque = 0xff000000;
+
+// `src` over `dst` with `coverage` in [0, 256], red and blue in one multiply and green and alpha in another
+static uint32_t blend(const uint32_t dst, const uint32_t src, const uint32_t coverage)
+{
+	const auto rb = ((src & 0xff00ff) * coverage + (dst & 0xff00ff) * (256 - coverage)) >> 8;
+	const auto ag = ((src >> 8 & 0xff00ff) * coverage + (dst >> 8 & 0xff00ff) * (256 - coverage)) >> 8;
+	return (rb & 0xff00ff) | (ag & 0xff00ff) << 8;
+}
+
+// validates the constructor's arguments before they size the pool
+static int tile_count(const int width, const int height, const int threads)
+{
+	if (width <= 0 || height <= 0)
+		throw std::invalid_argument("FrameRasterizer: width and height must be positive");
+	if (threads <= 0)
+		throw std::invalid_argument("FrameRasterizer: threads must be positive");
+	return std::min(threads, height);
+}
+
+FrameRasterizer::FrameRasterizer(const int width, const int height, const int threads)
+	: width(width),
+	  height(height),
+	  tiles(tile_count(width, height, threads)),
+	  // tile 0 is rendered by the caller of `render`
+	  pool(tiles, [this](const int tile)
+		   { render_tile(tile); }) {}
+
+void FrameRasterizer::set_background(std::vector<uint32_t> pixels)
+{
+	if (!pixels.empty() && pixels.size() != (size_t)width * height)
+		throw std::invalid_argument("FrameRasterizer::set_background: pixels must cover the frame");
+	background = std::move(pixels);
+}
+
+void FrameRasterizer::set_overlay(std::vector<uint32_t> pixels)
+{
+	if (!pixels.empty() && pixels.size() != (size_t)width * height)
+		throw std::invalid_argument("FrameRasterizer::set_overlay: pixels must cover the frame");
+	overlay = std::move(pixels);
+
+	// only rows with any coverage need compositing
+	const auto row_empty = [&](const int y)
+	{
+		return std::all_of(overlay.begin() + y * width, overlay.begin() + (y + 1) * width, [](const uint32_t p)
+						   { return !p; });
+	};
+	overlay_top = 0;
+	overlay_bottom = overlay.empty() ? 0 : height;
+	while (overlay_top < overlay_bottom && row_empty(overlay_top))
+		++overlay_top;
+	while (overlay_bottom > overlay_top && row_empty(overlay_bottom - 1))
+		--overlay_bottom;
+}
+
+void FrameRasterizer::box(const int x1, const int y1, const int x2, const int y2, const uint8_t r, const uint8_t g, const uint8_t b)
+{
+	Shape s{};
+	s.top = std::min(y1, y2);
+	s.bottom = std::max(y1, y2);
+	s.left = std::min(x1, x2);
+	s.right = std::max(x1, x2);
+	s.color = opaque | r << 16 | g << 8 | b;
+	shapes.push_back(s);
+}
+
+void FrameRasterizer::pill_from_bottom_left(const int x, const int y, const int w, const int h, const uint8_t r, const uint8_t g, const uint8_t b)
+{
+	if (w <= 0 || h <= 0)
+		throw std::invalid_argument("FrameRasterizer::pill_from_bottom_left: dimensions must be positive");
+
+	// `drawPillFromBottomLeft` is a `2 * radius + 1` wide box between two circles centered on `x + radius`,
+	// the lower one touching row `y` and the upper one `h - 1` rows higher. SDL2_gfx only anti-aliases radii from 4 up
+	Shape s{};
+	s.pill = true;
+	s.radius = w / 2;
+	s.antialiased = s.radius >= 4;
+	s.cx = x + s.radius;
+	s.cap_bottom = y - s.radius;
+	s.cap_top = y - h + 1 - s.radius;
+	// anti-aliased edges reach one pixel further out
+	s.top = s.cap_top - s.radius - s.antialiased;
+	s.bottom = s.cap_bottom + s.radius + s.antialiased;
+	s.left = s.cx - s.radius - s.antialiased;
+	s.right = s.cx + s.radius + s.antialiased;
+	s.color = opaque | r << 16 | g << 8 | b;
+	shapes.push_back(s);
+}
+
+void FrameRasterizer::draw_pill_row(uint32_t *const row, const Shape &pill, const int y) const
+{
+	const auto left = std::max(pill.left, 0), right = std::min(pill.right, width - 1);
+	const auto dy = y < pill.cap_top ? pill.cap_top - y : y > pill.cap_bottom ? y - pill.cap_bottom : 0;
+
+	// between the caps the pill is a plain span
+	if (!dy)
+	{
+		const auto l = std::max(pill.cx - pill.radius, 0), r = std::min(pill.cx + pill.radius, width - 1);
+		if (l <= r)
+			std::fill(row + l, row + r + 1, pill.color);
+		return;
+	}
+
+	for (int x = left; x <= right; ++x)
+	{
+		const auto dx = x - pill.cx;
+		const auto d2 = dx * dx + dy * dy;
+		if (!pill.antialiased)
+		{
+			// the pixels `filledCircleRGBA` fills
+			if (d2 <= pill.radius * (pill.radius + 1))
+				row[x] = pill.color;
+			continue;
+		}
+		// coverage falls from full at the radius to none one pixel further out, like `aacircleRGBA`'s outline
+		const auto coverage = std::clamp((int)std::lround((pill.radius + 1 - std::sqrt((float)d2)) * 256), 0, 256);
+		if (coverage == 256)
+			row[x] = pill.color;
+		else if (coverage)
+			row[x] = blend(row[x], pill.color, coverage);
+	}
+}
+
+void FrameRasterizer::render_tile(const int tile)
+{
+	const auto y0 = height * tile / tiles, y1 = height * (tile + 1) / tiles;
+	const auto frame = target + (size_t)y0 * width;
+	const size_t pixels = (size_t)(y1 - y0) * width;
+
+	if (background.empty())
+		std::fill_n(frame, pixels, opaque);
+	else
+		memcpy(frame, background.data() + (size_t)y0 * width, pixels * sizeof(uint32_t));
+
+	for (const auto &s : shapes)
+	{
+		const auto top = std::max(s.top, y0), bottom = std::min(s.bottom, y1 - 1);
+		for (int y = top; y <= bottom; ++y)
+		{
+			const auto row = target + (size_t)y * width;
+			if (s.pill)
+			{
+				draw_pill_row(row, s, y);
+				continue;
+			}
+			// a span fill, which the compiler turns into vector stores
+			const auto left = std::max(s.left, 0), right = std::min(s.right, width - 1);
+			if (left <= right)
+				std::fill(row + left, row + right + 1, s.color);
+		}
+	}
+
+	// premultiplied overlay: `overlay + frame * (1 - alpha)`, simple enough for the compiler to vectorize
+	const auto top = std::max(overlay_top, y0), bottom = std::min(overlay_bottom, y1);
+	for (int y = top; y < bottom; ++y)
+	{
+		const auto po = overlay.data() + (size_t)y * width;
+		const auto pf = target + (size_t)y * width;
+		for (int x = 0; x < width; ++x)
+		{
+			const uint32_t o = po[x], f = pf[x], inverse = 256 - (o >> 24);
+			const auto rb = ((f & 0xff00ff) * inverse >> 8) & 0xff00ff;
+			const auto g = ((f & 0x00ff00) * inverse >> 8) & 0x00ff00;
+			pf[x] = (o + rb + g) | opaque;
+		}
+	}
+}
+
+void FrameRasterizer::render(uint32_t *const frame)
+{
+	target = frame;
+	pool.run();
+	shapes.clear();
+}
@@ -1,12 +1,107 @@
 #include "FrequencySpectrum.hpp"
+#include "StageCounters.hpp"
 #include <stdexcept>
 #include <cstring>
 #include <memory>
+#include <string>
+#include <thread>
 
 FrequencySpectrum::FrequencySpectrum(const int fft_size)
-	: fft_size(fft_size)
+	: FrequencySpectrum(Options{fft_size}) {}
+
+FrequencySpectrum::FrequencySpectrum(const Options &opts)
+	: opts((opts.validate(), opts)) {}
+
+void FrequencySpectrum::Options::validate() const
 {
-	scale_max.set(*this);
+	if (fft_size <= 0)
+		throw std::invalid_argument("FrequencySpectrum::Options::validate: fft_size must be positive");
+	if (!nth_root)
+		throw std::invalid_argument("FrequencySpectrum::Options::validate: nth_root cannot be zero");
+	if (bands < 1 || bands > max_bands)
+		throw std::invalid_argument("FrequencySpectrum::Options::validate: bands must be between 1 and " + std::to_string(max_bands));
+	// each band's fft must be large enough for the band boundaries at 1/16 and 1/4 of its bins
+	if (bands > 1 && (fft_size % (1 << (2 * (bands - 1))) || band_fft_size() < 64))
+		throw std::invalid_argument("FrequencySpectrum::Options::validate: with " + std::to_string(bands) + " bands, fft_size must be a multiple of " + std::to_string(1 << (2 * (bands - 1))) + " and at least " + std::to_string(64 << (2 * (bands - 1))));
+	if (channels < 1 || channels > max_channels)
+		throw std::invalid_argument("FrequencySpectrum::Options::validate: channels must be between 1 and " + std::to_string(max_channels));
+}
+
+// a thread per channel at most: fftw splits batched plans by transform
+static int fft_threads(const int channels)
+{
+	return std::max(1, std::min<int>(channels, std::thread::hardware_concurrency()));
+}
+
+FrequencySpectrum::Config::Config(const Options &opts)
+	: opts((opts.validate(), opts)),
+	  fftw(opts.band_fft_size(), opts.channels, fft_threads(opts.channels))
+{
+	const auto n = fftw.input_size();
+
+	if (opts.wf != WindowFunction::NONE)
+	{
+		window.resize(n);
+		for (int i = 0; i < n; ++i)
+			window[i] = window_func(opts.wf, n, i);
+	}
+
+	// band `b` sees the signal at `samplerate / 4^b`, so its bins are 4^b times finer than band 0's.
+	// every band but the lowest leaves its bottom 1/16 of bins to the next band, and every band but band 0 only keeps
+	// its bottom 1/4, where the decimation filter neither attenuates nor aliases.
+	if (opts.bands > 1)
+		for (int b = 0; b < opts.bands; ++b)
+			levels.emplace_back(opts.channels * (opts.fft_size >> (2 * b)));
+	for (int b = 0; b < opts.bands; ++b)
+	{
+		Band band;
+		band.first_bin = b == opts.bands - 1 ? 0 : n / 16;
+		band.end_bin = b ? n / 4 : fftw.output_size();
+		band.bin_width = 1 << (2 * (opts.bands - 1 - b));
+		if (opts.am != AccumulationMethod::FILTERBANK)
+			band.bin_index.resize(band.end_bin - band.first_bin);
+		bands.emplace_back(std::move(band));
+	}
+
+	// all bands' bins form one list, from the lowest band up
+	int total_bins = 0;
+	for (auto band = bands.rbegin(); band != bands.rend(); ++band)
+	{
+		band->offset = total_bins;
+		total_bins += band->end_bin - band->first_bin;
+		if (opts.am == AccumulationMethod::FILTERBANK)
+			for (int i = band->first_bin; i < band->end_bin; ++i)
+			{
+				bin_positions.push_back(i * band->bin_width);
+				bin_widths.push_back(band->bin_width);
+			}
+	}
+	bins.assign(opts.channels, Bins(total_bins));
+	if (opts.am == AccumulationMethod::FILTERBANK)
+		amplitudes.resize(total_bins);
+
+	// the scale spans the bins of a single `fft_size` fft, whatever the number of bands
+	const auto max = opts.fft_size / 2 + 1;
+	scale_max.linear = max;
+	scale_max.log = ::log(max);
+	scale_max.sqrt = ::sqrt(max);
+	scale_max.cbrt = ::cbrt(max);
+	scale_max.nthroot = ::pow(max, 1.f / opts.nth_root);
+}
+
+std::unique_ptr<FrequencySpectrum::Config> FrequencySpectrum::swap_config(std::unique_ptr<Config> config)
+{
+	if (!config)
+		throw std::invalid_argument("FrequencySpectrum::swap_config: config is null");
+	opts = config->opts;
+	this->config.swap(config);
+	return config;
+}
+
+void FrequencySpectrum::commit()
+{
+	if (!config || config->opts != opts)
+		config = std::make_unique<Config>(opts);
 }
 
 void FrequencySpectrum::copy_channel_to_input(const float *const audio, const int num_channels, const int channel, const bool interleaved)
@@ -18,61 +113,304 @@ void FrequencySpectrum::copy_channel_to_input(const float *const audio, const in
 	if (channel >= num_channels)
 		throw std::invalid_argument("channel > num_channels");
 
+	const auto fft_size = committed_config().opts.fft_size;
+
 	if (!interleaved)
 	{
 		copy_to_input(audio + (channel * fft_size));
 		return;
 	}
 
-	const auto input = fftw.input();
+	const auto input = config->input(0);
 	for (int i = 0; i < fft_size; ++i)
 		input[i] = audio[i * num_channels + channel];
 }
 
+void FrequencySpectrum::copy_channels_to_input(const float *const audio, const int num_channels)
+{
+	auto &c = committed_config();
+	if (num_channels != c.opts.channels)
+		throw std::invalid_argument("FrequencySpectrum::copy_channels_to_input: num_channels must match the committed number of channels");
+
+	float *inputs[max_channels];
+	for (int ch = 0; ch < num_channels; ++ch)
+		inputs[ch] = c.input(ch);
+
+	// frame by frame, so that `audio` is read once, sequentially
+	for (int i = 0; i < c.opts.fft_size; ++i)
+		for (int ch = 0; ch < num_channels; ++ch)
+			inputs[ch][i] = audio[i * num_channels + ch];
+}
+
+void FrequencySpectrum::transform()
+{
+	auto &c = committed_config();
+	const auto n = c.fftw.input_size();
+
+	const auto channels = c.opts.channels;
+
+	StageCounters::Scope decimation(StageCounters::Stage::WINDOW);
+	for (size_t l = 1; l < c.levels.size(); ++l)
+	{
+		const auto in_size = c.levels[l - 1].size() / channels, out_size = c.levels[l].size() / channels;
+		for (int ch = 0; ch < channels; ++ch)
+			decimate(std::span(c.levels[l - 1]).subspan(ch * in_size, in_size), std::span(c.levels[l]).subspan(ch * out_size, out_size));
+	}
+	decimation.end();
+
+	for (size_t b = 0; b < c.bands.size(); ++b)
+	{
+		const auto &band = c.bands[b];
+
+		// apply window function on this band's most recent `n` samples, copying them into the fft input
+		StageCounters::Scope windowing(StageCounters::Stage::WINDOW);
+		for (int ch = 0; ch < channels; ++ch)
+		{
+			const auto input = c.fftw.input(ch);
+			const auto samples = c.levels.empty() ? input : c.levels[b].data() + (ch + 1) * (c.levels[b].size() / channels) - n;
+			if (!c.window.empty())
+				for (int i = 0; i < n; ++i)
+					input[i] = samples[i] * c.window[i];
+			else if (samples != input)
+				memcpy(input, samples, n * sizeof(float));
+		}
+
+		windowing.end();
+
+		// execute the ffts of all channels at once and keep this band's share of the output
+		const StageCounters::Scope fft(StageCounters::Stage::FFT);
+		c.fftw.execute();
+		for (int ch = 0; ch < channels; ++ch)
+		{
+			// std::complex<float> is guaranteed to have the layout of fftwf_complex
+			const auto output = reinterpret_cast<const std::complex<float> *>(c.fftw.output(ch));
+			std::copy(output + band.first_bin, output + band.end_bin, c.bins[ch].begin() + band.offset);
+		}
+	}
+}
+
 void FrequencySpectrum::render(std::vector<float> &spectrum)
 {
-	// apply window function on input
-	const auto input = fftw.input();
-	for (int i = 0; i < fft_size; ++i)
-		input[i] *= window_func(i);
+	transform();
+	render(config->bins[0], spectrum);
+}
+
+void FrequencySpectrum::render(const Bins &bins, std::vector<float> &spectrum)
+{
+	auto &c = committed_config();
+	const auto &opts = c.opts;
 
-	// execute fft and get output
-	fftw.execute();
-	const auto output = fftw.output();
+	if (bins.size() != c.bins[0].size())
+		throw std::invalid_argument("FrequencySpectrum::render: bins do not match the committed config");
+
+	StageCounters::Scope binning(StageCounters::Stage::BINNING);
 
 	// zero out array since we are accumulating
 	std::ranges::fill(spectrum, 0);
 
-	// map frequency bins of freqdata to spectrum
-	for (int i = 0; i < fftw.output_size(); ++i)
+	// the bin -> spectrum index mapping only depends on the spectrum size, so only recompute it when that changes
+	if (c.bin_index_size != spectrum.size())
 	{
-		const auto [re, im] = output[i];
-		// must divide by fft_size here to counteract the correlation
-		// between fft_size and the average amplitude across the spectrum vector.
-		const float amplitude = sqrt((re * re) + (im * im)) / fft_size;
-		const auto index = calc_index(i, spectrum.size());
+		if (opts.am == AccumulationMethod::FILTERBANK)
+			build_filterbank(c, spectrum.size());
+		else
+			for (auto &band : c.bands)
+				for (int i = band.first_bin; i < band.end_bin; ++i)
+					band.bin_index[i - band.first_bin] = calc_index(c, i * band.bin_width, spectrum.size());
+		c.bin_index_size = spectrum.size();
+	}
 
-		switch (am)
+	// must divide by the fft size here to counteract the correlation
+	// between fft size and the average amplitude across the spectrum vector.
+	const auto n = c.fftw.input_size();
+	const auto amplitude = [&](const int k)
+	{
+		const auto re = bins[k].real(), im = bins[k].imag();
+		return sqrt((re * re) + (im * im)) / n;
+	};
+
+	if (opts.am == AccumulationMethod::FILTERBANK)
+	{
+		for (size_t k = 0; k < bins.size(); ++k)
+			c.amplitudes[k] = amplitude(k);
+		apply_filterbank(c, spectrum);
+		return;
+	}
+
+	// map frequency bins to spectrum
+	for (const auto &band : c.bands)
+		for (int i = band.first_bin; i < band.end_bin; ++i)
 		{
-		case AccumulationMethod::SUM:
-			spectrum[index] += amplitude;
-			break;
+			const float a = amplitude(band.offset + i - band.first_bin);
+			const auto index = band.bin_index[i - band.first_bin];
 
-		case AccumulationMethod::MAX:
-			spectrum[index] = std::max(spectrum[index], amplitude);
-			break;
+			switch (opts.am)
+			{
+			case AccumulationMethod::SUM:
+				// a coarse bin stands in for `bin_width` full-resolution bins
+				spectrum[index] += band.bin_width * a;
+				break;
 
-		default:
-			throw std::logic_error("FrequencySpectrum::render: switch(accum_type): default case hit");
+			case AccumulationMethod::MAX:
+				spectrum[index] = std::max(spectrum[index], a);
+				break;
+
+			default:
+				throw std::logic_error("FrequencySpectrum::render: switch(accum_type): default case hit");
+			}
 		}
-	}
+
+	binning.end();
 
 	// apply interpolation if necessary
-	if (interp != InterpolationType::NONE && scale != Scale::LINEAR)
+	if (opts.interp != InterpolationType::NONE && opts.scale != Scale::LINEAR)
+	{
+		const StageCounters::Scope interpolation(StageCounters::Stage::INTERPOLATION);
 		interpolate(spectrum);
+	}
+}
+
+void FrequencySpectrum::mix(const Bins &a, const float wa, const Bins &b, const float wb, Bins &out)
+{
+	if (a.size() != b.size())
+		throw std::invalid_argument("FrequencySpectrum::mix: a and b must be the same size");
+	out.resize(a.size());
+	// as floats, so that it vectorizes like any other loop over floats
+	const auto pa = reinterpret_cast<const float *>(a.data()), pb = reinterpret_cast<const float *>(b.data());
+	const auto po = reinterpret_cast<float *>(out.data());
+	for (size_t i = 0; i < 2 * a.size(); ++i)
+		po[i] = wa * pa[i] + wb * pb[i];
 }
 
-float FrequencySpectrum::window_func(const int i)
+void FrequencySpectrum::build_filterbank(Config &c, const int size)
+{
+	auto &fb = c.filterbank;
+	const int bins = c.bin_positions.size();
+
+	// bins are sorted by frequency, and the scale is monotonic, so these are sorted too
+	fb.bin_bars.resize(bins);
+	for (int k = 0; k < bins; ++k)
+		fb.bin_bars[k] = calc_index_ratio(c, c.bin_positions[k]) * size;
+
+	fb.row_start.assign(1, 0);
+	fb.first_column.clear();
+	fb.weights.clear();
+
+	// filter `j` is centered on `j + 0.5` and reaches the centers of its neighbours
+	int lo = 0;
+	for (int j = 0; j < size; ++j)
+	{
+		const float center = j + 0.5f;
+		while (lo < bins && fb.bin_bars[lo] <= center - 1)
+			++lo;
+		int hi = lo;
+		while (hi < bins && fb.bin_bars[hi] < center + 1)
+			++hi;
+
+		// as with `SUM`, a coarse bin stands in for `bin_width` full-resolution bins, so every weight is scaled by it
+		if (hi > lo)
+		{
+			fb.first_column.push_back(lo);
+			for (int k = lo; k < hi; ++k)
+				fb.weights.push_back(c.bin_widths[k] * (1 - std::abs(fb.bin_bars[k] - center)));
+		}
+		// no bin within reach, which happens where bins are wider than spectrum indices:
+		// interpolate linearly between the bins on either side instead of leaving a gap
+		else if (!lo || lo == bins)
+		{
+			const auto k = std::min(lo, bins - 1);
+			fb.first_column.push_back(k);
+			fb.weights.push_back(c.bin_widths[k]);
+		}
+		else
+		{
+			const auto t = (center - fb.bin_bars[lo - 1]) / (fb.bin_bars[lo] - fb.bin_bars[lo - 1]);
+			fb.first_column.push_back(lo - 1);
+			fb.weights.push_back(c.bin_widths[lo - 1] * (1 - t));
+			fb.weights.push_back(c.bin_widths[lo] * t);
+		}
+		fb.row_start.push_back(fb.weights.size());
+	}
+}
+
+void FrequencySpectrum::apply_filterbank(const Config &c, std::vector<float> &spectrum)
+{
+	const auto &fb = c.filterbank;
+	for (size_t j = 0; j < spectrum.size(); ++j)
+	{
+		const auto w = fb.weights.data() + fb.row_start[j];
+		const auto a = c.amplitudes.data() + fb.first_column[j];
+		const int len = fb.row_start[j + 1] - fb.row_start[j];
+
+		// eight partial sums, so that the dot product vectorizes without reassociating float additions
+		float acc[8]{};
+		int k = 0;
+		for (; k + 8 <= len; k += 8)
+			for (int l = 0; l < 8; ++l)
+				acc[l] += w[k + l] * a[k + l];
+		float sum = 0;
+		for (const auto x : acc)
+			sum += x;
+		for (; k < len; ++k)
+			sum += w[k] * a[k];
+		spectrum[j] = sum;
+	}
+}
+
+// lowpass for decimating by 4: 45-tap windowed sinc, flat up to 1/16 of the input rate (half the output band)
+// and rejecting everything from 3/16 on, which is all that could alias into that range.
+// a quarter of the taps fall on zeros of the sinc or the window, so only the others are kept, with their positions.
+static const int decimation_taps = 45;
+static const auto decimation_filter = []
+{
+	static const double cutoff = 0.125;
+	std::vector<std::pair<int, float>> h;
+	double sum = 0;
+	for (int i = 0; i < decimation_taps; ++i)
+	{
+		const double x = i - (decimation_taps - 1) / 2.;
+		const double sinc = x ? sin(2 * M_PI * cutoff * x) / (M_PI * x) : 2 * cutoff;
+		const double blackman = 0.42 - 0.5 * cos(2 * M_PI * i / (decimation_taps - 1)) + 0.08 * cos(4 * M_PI * i / (decimation_taps - 1));
+		if (const auto tap = sinc * blackman; std::abs(tap) > 1e-9)
+		{
+			h.emplace_back(i, tap);
+			sum += tap;
+		}
+	}
+	// unity gain at dc
+	for (auto &[i, tap] : h)
+		tap /= sum;
+	return h;
+}();
+
+void FrequencySpectrum::decimate(const std::span<const float> in, const std::span<float> out)
+{
+	const int n = out.size();
+	// output k filters inputs [4k - offset, 4k + 3]; the taps are symmetric, so their order doesn't matter
+	const int offset = decimation_taps - 4;
+
+	// outputs whose filter reaches before the start of the input: count those samples as zero
+	const int first_full = std::min(n, (offset + 3) / 4);
+	for (int k = 0; k < first_full; ++k)
+	{
+		float acc = 0;
+		for (const auto &[t, h] : decimation_filter)
+			if (const int i = 4 * k - offset + t; i >= 0)
+				acc += h * in[i];
+		out[k] = acc;
+	}
+
+	// the rest one tap at a time across all outputs, so that the inner loop vectorizes
+	std::fill(out.begin() + first_full, out.end(), 0);
+	for (const auto &[t, h] : decimation_filter)
+	{
+		const auto x = in.data() + t - offset;
+		for (int k = first_full; k < n; ++k)
+			out[k] += h * x[4 * k];
+	}
+}
+
+float FrequencySpectrum::window_func(const WindowFunction wf, const int fft_size, const int i)
 {
 	switch (wf)
 	{
@@ -87,21 +425,22 @@ float FrequencySpectrum::window_func(const int i)
 	}
 }
 
-int FrequencySpectrum::calc_index(const int i, const int max_index)
+int FrequencySpectrum::calc_index(const Config &config, const int i, const int max_index)
 {
-	return std::max(0, std::min((int)(calc_index_ratio(i) * max_index), max_index - 1));
+	return std::max(0, std::min((int)(calc_index_ratio(config, i) * max_index), max_index - 1));
 }
 
-float FrequencySpectrum::calc_index_ratio(const float i)
+float FrequencySpectrum::calc_index_ratio(const Config &config, const float i)
 {
-	switch (scale)
+	const auto &scale_max = config.scale_max;
+	switch (config.opts.scale)
 	{
 	case Scale::LINEAR:
 		return i / scale_max.linear;
 	case Scale::LOG:
 		return log(i ? i : 1) / scale_max.log;
 	case Scale::NTH_ROOT:
-		switch (nth_root)
+		switch (config.opts.nth_root)
 		{
 		case 1:
 			return i / scale_max.linear;
@@ -110,7 +449,7 @@ float FrequencySpectrum::calc_index_ratio(const float i)
 		case 3:
 			return cbrt(i) / scale_max.cbrt;
 		default:
-			return pow(i, nthroot_inv) / scale_max.nthroot;
+			return pow(i, 1.f / config.opts.nth_root) / scale_max.nthroot;
 		}
 	default:
 		throw std::logic_error("FrequencySpectrum::calc_index_ratio: default case hit");
@@ -119,21 +458,30 @@ float FrequencySpectrum::calc_index_ratio(const float i)
 
 void FrequencySpectrum::interpolate(std::vector<float> &spectrum)
 {
+	// only allocate when the spectrum grows, not on every frame
+	if (spline_x.capacity() < spectrum.size())
+	{
+		spline_x.reserve(spectrum.size());
+		spline_y.reserve(spectrum.size());
+		spline.reserve(spectrum.size());
+	}
+
 	// separate the nonzero values (y's) and their indices (x's)
-	std::vector<double> nonzero_values, indices;
+	spline_x.clear();
+	spline_y.clear();
 	for (int i = 0; i < (int)spectrum.size(); ++i)
 	{
 		if (!spectrum[i])
 			continue;
-		nonzero_values.push_back(spectrum[i]);
-		indices.push_back(i);
+		spline_y.push_back(spectrum[i]);
+		spline_x.push_back(i);
 	}
 
 	// tk::spline::set_points throws if there are less than 3 points
-	if (indices.size() < 3)
+	if (spline_x.size() < 3)
 		return;
 
-	spline.set_points(indices, nonzero_values, (tk::spline::spline_type)interp);
+	spline.set_points(spline_x, spline_y, (tk::spline::spline_type)committed_config().opts.interp);
 
 	// only copy spline values to fill in the gaps
 	for (size_t i = 0; i < spectrum.size(); ++i)
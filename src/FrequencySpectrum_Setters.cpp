@@ -3,35 +3,48 @@
 
 void FrequencySpectrum::set_fft_size(const int fft_size)
 {
-	this->fft_size = fft_size;
-	fftw.set_n(fft_size);
-	scale_max.set(*this);
+	update_options([&](Options &opts)
+				   { opts.fft_size = fft_size; });
 }
 
 void FrequencySpectrum::set_interp_type(const InterpolationType interp)
 {
-	this->interp = interp;
+	update_options([&](Options &opts)
+				   { opts.interp = interp; });
 }
 
 void FrequencySpectrum::set_window_func(const WindowFunction wf)
 {
-	this->wf = wf;
+	update_options([&](Options &opts)
+				   { opts.wf = wf; });
 }
 
 void FrequencySpectrum::set_accum_method(const AccumulationMethod am)
 {
-	this->am = am;
+	update_options([&](Options &opts)
+				   { opts.am = am; });
 }
 
 void FrequencySpectrum::set_scale(const Scale scale)
 {
-	this->scale = scale;
+	update_options([&](Options &opts)
+				   { opts.scale = scale; });
 }
 
 void FrequencySpectrum::set_nth_root(const int nth_root)
 {
-	if (!nth_root)
-		throw std::invalid_argument("FrequencySpectrun::set_nth_root: nth_root cannot be zero!");
-	this->nth_root = nth_root;
-	nthroot_inv = 1.f / nth_root;
-}
\ No newline at end of file
+	update_options([&](Options &opts)
+				   { opts.nth_root = nth_root; });
+}
+
+void FrequencySpectrum::set_channels(const int channels)
+{
+	update_options([&](Options &opts)
+				   { opts.channels = channels; });
+}
+
+void FrequencySpectrum::set_resolution_bands(const int bands)
+{
+	update_options([&](Options &opts)
+				   { opts.bands = bands; });
+}
@@ -0,0 +1,382 @@
+#include "LibavEncoder.hpp"
+#include <stdexcept>
+
+#ifdef AUDIOVIZ_LIBAV
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/imgutils.h>
+#include <libswscale/swscale.h>
+}
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+const bool LibavEncoder::available = true;
+
+static std::string error_string(const int err)
+{
+	char buf[AV_ERROR_MAX_STRING_SIZE];
+	av_strerror(err, buf, sizeof(buf));
+	return buf;
+}
+
+// throws if `ret` is a libav error code
+static int check(const int ret, const char *const what)
+{
+	if (ret < 0)
+		throw std::runtime_error(std::string("LibavEncoder: ") + what + ": " + error_string(ret));
+	return ret;
+}
+
+// throws if a libav allocation or lookup returned null
+template <typename T>
+static T *check(T *const ptr, const char *const what)
+{
+	if (!ptr)
+		throw std::runtime_error(std::string("LibavEncoder: ") + what + " failed");
+	return ptr;
+}
+
+// `name` is an encoder (e.g. `libx264`) or a codec (e.g. `h264`), like `ffmpeg -c` accepts
+static const AVCodec *find_encoder(const std::string &name)
+{
+	if (const auto codec = avcodec_find_encoder_by_name(name.c_str()))
+		return codec;
+	if (const auto descriptor = avcodec_descriptor_get_by_name(name.c_str()))
+		if (const auto codec = avcodec_find_encoder(descriptor->id))
+			return codec;
+	throw std::runtime_error("LibavEncoder: no encoder for " + name);
+}
+
+// formats an encoder accepts, terminated by `AV_PIX_FMT_NONE`/`AV_SAMPLE_FMT_NONE`; null if it accepts any
+static const AVPixelFormat *pixel_formats(const AVCodecContext *const ctx, const AVCodec *const codec)
+{
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(61, 13, 100)
+	const void *formats = nullptr;
+	avcodec_get_supported_config(ctx, codec, AV_CODEC_CONFIG_PIX_FORMAT, 0, &formats, nullptr);
+	return (const AVPixelFormat *)formats;
+#else
+	(void)ctx;
+	return codec->pix_fmts;
+#endif
+}
+
+static const AVSampleFormat *sample_formats(const AVCodecContext *const ctx, const AVCodec *const codec)
+{
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(61, 13, 100)
+	const void *formats = nullptr;
+	avcodec_get_supported_config(ctx, codec, AV_CODEC_CONFIG_SAMPLE_FORMAT, 0, &formats, nullptr);
+	return (const AVSampleFormat *)formats;
+#else
+	(void)ctx;
+	return codec->sample_fmts;
+#endif
+}
+
+static AVPixelFormat pixel_format(const LibavEncoder::InputFormat format)
+{
+	switch (format)
+	{
+	case LibavEncoder::InputFormat::BGRA:
+		return AV_PIX_FMT_BGRA;
+	case LibavEncoder::InputFormat::RGB24:
+		return AV_PIX_FMT_RGB24;
+	case LibavEncoder::InputFormat::YUV420P:
+		return AV_PIX_FMT_YUV420P;
+	case LibavEncoder::InputFormat::NV12:
+		return AV_PIX_FMT_NV12;
+	default:
+		throw std::logic_error("pixel_format: default case hit");
+	}
+}
+
+template <typename T>
+static bool supports(const T *const formats, const T format, const T none)
+{
+	if (!formats)
+		return true;
+	for (auto f = formats; *f != none; ++f)
+		if (*f == format)
+			return true;
+	return false;
+}
+
+static const std::pair<const char *, int> log_levels[]{
+	{"quiet", AV_LOG_QUIET},
+	{"panic", AV_LOG_PANIC},
+	{"fatal", AV_LOG_FATAL},
+	{"error", AV_LOG_ERROR},
+	{"warning", AV_LOG_WARNING},
+	{"info", AV_LOG_INFO},
+	{"verbose", AV_LOG_VERBOSE},
+	{"debug", AV_LOG_DEBUG},
+	{"trace", AV_LOG_TRACE}};
+
+LibavEncoder::LibavEncoder(const std::string &output_file, const int width, const int height, const int fps, const InputFormat input_format,
+						   const std::string &vcodec, const std::string &acodec, const std::string &audio_file, const std::string &loglevel)
+	: width(width),
+	  height(height),
+	  fps(fps),
+	  input_format(input_format),
+	  pcm(audio_file.empty() ? SndfileHandle() : SndfileHandle(audio_file))
+{
+	if (!audio_file.empty() && pcm.error())
+		throw std::runtime_error(audio_file + ": " + pcm.strError());
+
+	if (!loglevel.empty())
+	{
+		const auto level = std::ranges::find(log_levels, loglevel, &std::pair<const char *, int>::first);
+		if (level == std::end(log_levels))
+			throw std::invalid_argument("LibavEncoder: unknown log level: " + loglevel);
+		// process-wide, like every other libav setting
+		av_log_set_level(level->second);
+	}
+
+	try
+	{
+		check(avformat_alloc_output_context2(&format, nullptr, nullptr, output_file.c_str()), "avformat_alloc_output_context2");
+		const bool global_header = format->oformat->flags & AVFMT_GLOBALHEADER;
+
+		// video: timestamps count frames
+		const auto video_codec = find_encoder(vcodec);
+		video = check(avcodec_alloc_context3(video_codec), "avcodec_alloc_context3");
+		video->width = width;
+		video->height = height;
+		video->time_base = {1, fps};
+		video->framerate = {fps, 1};
+		// the input's own format if the encoder takes it, so that no conversion is needed
+		const auto input_pix_fmt = pixel_format(input_format);
+		const auto formats = pixel_formats(video, video_codec);
+		video->pix_fmt = supports(formats, input_pix_fmt, AV_PIX_FMT_NONE)		  ? input_pix_fmt
+						 : supports(formats, AV_PIX_FMT_YUV420P, AV_PIX_FMT_NONE) ? AV_PIX_FMT_YUV420P
+																				  : formats[0];
+		// let the encoder use as many threads as it sees fit
+		video->thread_count = 0;
+		if (global_header)
+			video->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+		check(avcodec_open2(video, video_codec, nullptr), "avcodec_open2 (video)");
+		video_stream = check(avformat_new_stream(format, nullptr), "avformat_new_stream");
+		video_stream->time_base = video->time_base;
+		check(avcodec_parameters_from_context(video_stream->codecpar, video), "avcodec_parameters_from_context");
+
+		// audio: timestamps count samples, so they are exact whatever the frame rate. none without an audio file
+		if (pcm)
+		{
+			const auto audio_codec = acodec == "copy" ? check(avcodec_find_encoder(format->oformat->audio_codec), "finding the container's audio encoder")
+													  : find_encoder(acodec);
+			audio = check(avcodec_alloc_context3(audio_codec), "avcodec_alloc_context3");
+			audio->sample_rate = pcm.samplerate();
+			av_channel_layout_default(&audio->ch_layout, pcm.channels());
+			audio->time_base = {1, pcm.samplerate()};
+			audio->sample_fmt = AV_SAMPLE_FMT_NONE;
+			for (const auto f : {AV_SAMPLE_FMT_FLTP, AV_SAMPLE_FMT_FLT, AV_SAMPLE_FMT_S16P, AV_SAMPLE_FMT_S16})
+				if (supports(sample_formats(audio, audio_codec), f, AV_SAMPLE_FMT_NONE))
+				{
+					audio->sample_fmt = f;
+					break;
+				}
+			if (audio->sample_fmt == AV_SAMPLE_FMT_NONE)
+				throw std::runtime_error(std::string("LibavEncoder: ") + audio_codec->name + " takes no float or 16-bit samples");
+			if (global_header)
+				audio->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+			check(avcodec_open2(audio, audio_codec, nullptr), "avcodec_open2 (audio)");
+			audio_stream = check(avformat_new_stream(format, nullptr), "avformat_new_stream");
+			audio_stream->time_base = audio->time_base;
+			check(avcodec_parameters_from_context(audio_stream->codecpar, audio), "avcodec_parameters_from_context");
+
+			const auto variable_frame_size = audio_codec->capabilities & AV_CODEC_CAP_VARIABLE_FRAME_SIZE;
+			audio_frame_size = variable_frame_size || !audio->frame_size ? 1024 : audio->frame_size;
+			short_last_frame = variable_frame_size || (audio_codec->capabilities & AV_CODEC_CAP_SMALL_LAST_FRAME);
+			audio_frame = check(av_frame_alloc(), "av_frame_alloc");
+			audio_frame->format = audio->sample_fmt;
+			audio_frame->sample_rate = audio->sample_rate;
+			audio_frame->nb_samples = audio_frame_size;
+			check(av_channel_layout_copy(&audio_frame->ch_layout, &audio->ch_layout), "av_channel_layout_copy");
+			check(av_frame_get_buffer(audio_frame, 0), "av_frame_get_buffer");
+			pcm_buffer.resize(audio_frame_size * pcm.channels());
+		}
+
+		if (!(format->oformat->flags & AVFMT_NOFILE))
+			check(avio_open(&format->pb, output_file.c_str(), AVIO_FLAG_WRITE), "avio_open");
+		check(avformat_write_header(format, nullptr), "avformat_write_header");
+
+		video_frame = check(av_frame_alloc(), "av_frame_alloc");
+		video_frame->format = video->pix_fmt;
+		video_frame->width = width;
+		video_frame->height = height;
+		check(av_frame_get_buffer(video_frame, 0), "av_frame_get_buffer");
+
+		packet = check(av_packet_alloc(), "av_packet_alloc");
+		if (video->pix_fmt != input_pix_fmt)
+			sws = check(sws_getContext(width, height, input_pix_fmt, width, height, video->pix_fmt, SWS_BILINEAR, nullptr, nullptr, nullptr),
+						"sws_getContext");
+	}
+	catch (...)
+	{
+		cleanup();
+		throw;
+	}
+}
+
+LibavEncoder::~LibavEncoder()
+{
+	cleanup();
+}
+
+void LibavEncoder::cleanup()
+{
+	sws_freeContext(sws);
+	sws = nullptr;
+	av_packet_free(&packet);
+	av_frame_free(&video_frame);
+	av_frame_free(&audio_frame);
+	avcodec_free_context(&video);
+	avcodec_free_context(&audio);
+	if (format)
+	{
+		if (!(format->oformat->flags & AVFMT_NOFILE))
+			avio_closep(&format->pb);
+		avformat_free_context(format);
+		format = nullptr;
+	}
+}
+
+void LibavEncoder::encode(AVCodecContext *const codec, AVStream *const stream, AVFrame *const frame)
+{
+	check(avcodec_send_frame(codec, frame), "avcodec_send_frame");
+	for (;;)
+	{
+		const auto ret = avcodec_receive_packet(codec, packet);
+		if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
+			return;
+		check(ret, "avcodec_receive_packet");
+		av_packet_rescale_ts(packet, codec->time_base, stream->time_base);
+		packet->stream_index = stream->index;
+		// takes the packet's reference, and keeps streams interleaved by buffering as needed
+		check(av_interleaved_write_frame(format, packet), "av_interleaved_write_frame");
+	}
+}
+
+void LibavEncoder::encode_audio(const long end, const bool last)
+{
+	if (!audio)
+		return;
+	const auto channels = pcm.channels();
+	while (end - samples >= audio_frame_size || (last && samples < end))
+	{
+		const auto wanted = std::min<long>(audio_frame_size, end - samples);
+		const auto read = pcm.readf(pcm_buffer.data(), wanted);
+		if (read <= 0)
+			return;
+		const int n = short_last_frame ? read : audio_frame_size;
+		// pad with silence up to the frame size, if the codec needs it
+		std::fill(pcm_buffer.begin() + read * channels, pcm_buffer.begin() + n * channels, 0.f);
+
+		check(av_frame_make_writable(audio_frame), "av_frame_make_writable");
+		const auto data = audio_frame->extended_data;
+		const auto s16 = [](const float x)
+		{ return (int16_t)std::lround(std::clamp(x, -1.f, 1.f) * 32767); };
+		switch (audio->sample_fmt)
+		{
+		case AV_SAMPLE_FMT_FLTP:
+			for (int c = 0; c < channels; ++c)
+				for (int i = 0; i < n; ++i)
+					((float *)data[c])[i] = pcm_buffer[i * channels + c];
+			break;
+		case AV_SAMPLE_FMT_FLT:
+			std::copy_n(pcm_buffer.begin(), n * channels, (float *)data[0]);
+			break;
+		case AV_SAMPLE_FMT_S16P:
+			for (int c = 0; c < channels; ++c)
+				for (int i = 0; i < n; ++i)
+					((int16_t *)data[c])[i] = s16(pcm_buffer[i * channels + c]);
+			break;
+		case AV_SAMPLE_FMT_S16:
+			for (int i = 0; i < n * channels; ++i)
+				((int16_t *)data[0])[i] = s16(pcm_buffer[i]);
+			break;
+		default:
+			throw std::logic_error("LibavEncoder::encode_audio: default case hit");
+		}
+
+		audio_frame->nb_samples = n;
+		audio_frame->pts = samples;
+		samples += read;
+		encode(audio, audio_stream, audio_frame);
+	}
+}
+
+void LibavEncoder::write(const void *const pixels)
+{
+	check(av_frame_make_writable(video_frame), "av_frame_make_writable");
+	// the planes of `pixels`, packed
+	uint8_t *src[4];
+	int stride[4];
+	check(av_image_fill_arrays(src, stride, (const uint8_t *)pixels, pixel_format(input_format), width, height, 1), "av_image_fill_arrays");
+	if (sws)
+		sws_scale(sws, (const uint8_t **)src, stride, 0, height, video_frame->data, video_frame->linesize);
+	else
+		av_image_copy(video_frame->data, video_frame->linesize, (const uint8_t **)src, stride, video->pix_fmt, width, height);
+	write_frame();
+}
+
+bool LibavEncoder::in_place() const
+{
+	return !sws;
+}
+
+void LibavEncoder::frame_planes(uint8_t *planes[3], int strides[3])
+{
+	check(av_frame_make_writable(video_frame), "av_frame_make_writable");
+	std::copy_n(video_frame->data, 3, planes);
+	std::copy_n(video_frame->linesize, 3, strides);
+}
+
+void LibavEncoder::write_frame()
+{
+	video_frame->pts = frames++;
+	encode(video, video_stream, video_frame);
+
+	// audio up to the end of this frame, so that the muxer interleaves as it goes
+	encode_audio(frames * pcm.samplerate() / fps, false);
+}
+
+void LibavEncoder::finish()
+{
+	if (finished)
+		return;
+	finished = true;
+	// the audio stops with the video, like `ffmpeg -shortest`
+	encode_audio(frames * pcm.samplerate() / fps, true);
+	encode(video, video_stream, nullptr);
+	if (audio)
+		encode(audio, audio_stream, nullptr);
+	check(av_write_trailer(format), "av_write_trailer");
+	cleanup();
+}
+
+#else
+
+const bool LibavEncoder::available = false;
+
+LibavEncoder::LibavEncoder(const std::string &, const int width, const int height, const int fps, const InputFormat input_format,
+						   const std::string &, const std::string &, const std::string &, const std::string &)
+	: width(width),
+	  height(height),
+	  fps(fps),
+	  input_format(input_format)
+{
+	throw std::runtime_error("LibavEncoder: built without libav, rebuild with `make libav=1`");
+}
+
+LibavEncoder::~LibavEncoder() {}
+void LibavEncoder::write(const void *) {}
+bool LibavEncoder::in_place() const { return false; }
+void LibavEncoder::frame_planes(uint8_t *[3], int[3]) {}
+void LibavEncoder::write_frame() {}
+void LibavEncoder::finish() {}
+
+#endif
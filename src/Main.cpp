@@ -1,43 +1,154 @@
 #include "Main.hpp"
+#include "StageCounters.hpp"
+#include <SDL2pp/SDLTTF.hh>
+#include <cstdio>
+#include <optional>
+#include <sstream>
 
 Main::Main(const int argc, const char *const *const argv)
-	: Args(argc, argv), Visualizer(get("audio_file"), get<uint>("--width"), get<uint>("--height"))
+	: Args(argc, argv)
 {
-	// all of these have default values, no need to try-catch
-	set_sample_size(get<uint>("-n"));
-	set_multiplier(get<float>("-m"));
-	set_bar_width(get<uint>("-bw"));
-	set_bar_spacing(get<uint>("-bs"));
-	set_mono(get<int>("--mono"));
+	run(argc, argv);
+	StageCounters::report(std::cerr);
+}
 
-	// finally i realized what `present` does
-	// no need to try-catch on `get` anymore...
+Main::Main(const int argc, const char *const *const argv, std::shared_ptr<AssetCache> batch_assets)
+	: Args(argc, argv, false),
+	  batch_assets(batch_assets)
+{
+	if (is_used("--batch"))
+		throw std::invalid_argument("batch jobs cannot use '--batch'");
+	if (!is_used("--encode") && !is_used("--renditions") && !is_used("--dump"))
+		throw std::invalid_argument("batch jobs must use '--encode', '--renditions' or '--dump'");
+	run(argc, argv);
+}
 
-	if (const auto ffmpeg_path = present("--ffmpeg-path"))
-		set_ffmpeg_path(ffmpeg_path.value());
+void Main::run(const int argc, const char *const *const argv)
+{
+	if (!get<uint>("-j"))
+		throw std::invalid_argument("'-j' must be positive");
 
-	if (const auto bg = present("--bg"))
-		set_background(bg.value());
-	
-	if (const auto album_art = present("--album-art"))
-		set_album_art(album_art.value());
+	// --batch (many jobs in one process)
+	if (const auto manifest = present("--batch"))
+	{
+		run_batch(argv[0], manifest.value());
+		return;
+	}
 
-	{ // bar type
-		const auto &bt_str = get("-bt");
-		if (bt_str == "bar")
-			set_bar_type(SR::BarType::RECTANGLE);
-		else if (bt_str == "pill")
-			set_bar_type(SR::BarType::PILL);
-		else
-			throw std::invalid_argument("unknown bar type: " + bt_str);
+	if (get("audio_file").empty())
+		throw std::invalid_argument("audio_file is required");
+
+	// --segments (one encode split across worker processes), unless this is one of the workers
+	if (is_used("--segments") && !is_used("--segment"))
+	{
+		run_segments(argc, argv);
+		return;
+	}
+
+	// --renditions (several videos from one analysis pass)
+	if (is_used("--renditions"))
+	{
+		run_renditions();
+		return;
 	}
 
+	// --dump (analysis only, no window)
+	if (const auto dump_file = present("--dump"))
+		dump_spectrum(dump_file.value());
+	else
+		visualize();
+}
+
+void Main::run_batch(const char *const program, const std::string &manifest)
+{
+	// jobs render headless, but fonts still need SDL_ttf; initialize it once for all of them
+	SDL2pp::SDL sdl(0);
+	SDL2pp::SDLTTF ttf;
+	const auto assets = std::make_shared<AssetCache>();
+
+	const int failed = BatchRunner(manifest).run(get<uint>("-j"), [&](const BatchRunner::Job &job)
+	{
+		std::vector<const char *> argv{program};
+		for (const auto &arg : job)
+			argv.emplace_back(arg.c_str());
+		Main(argv.size(), argv.data(), assets);
+	});
+
+	if (failed)
+		throw std::runtime_error(std::to_string(failed) + " batch job(s) failed");
+}
+
+void Main::run_segments(const int argc, const char *const *const argv)
+{
+	const auto &encode_args = get<std::vector<std::string>>("--encode");
+	if (encode_args.empty())
+		throw std::invalid_argument("'--segments' requires '--encode'");
+
+	SegmentedEncode encode(encode_args[0], get<uint>("--segments"), {argv + 1, argv + argc});
+	if (const auto failed = encode.run(argv[0], get<uint>("-j")))
+		throw std::runtime_error(std::to_string(failed) + " segment(s) failed; run the same command again to resume");
+	encode.concat(present("--ffmpeg-path").value_or("ffmpeg"), get("audio_file"), encode_args.size() == 4 ? encode_args[3] : "copy");
+}
+
+void Main::run_renditions()
+{
+	if (is_used("--encode") || is_used("--segments") || is_used("--dump"))
+		throw std::invalid_argument("'--renditions' cannot be combined with '--encode', '--segments' or '--dump'");
+
+	// renditions render headless; a batch has already initialized SDL for its jobs
+	std::optional<SDL2pp::SDL> sdl;
+	std::optional<SDL2pp::SDLTTF> ttf;
+	if (!batch_assets)
+	{
+		sdl.emplace(0);
+		ttf.emplace();
+	}
+	const auto assets = batch_assets ? batch_assets : std::make_shared<AssetCache>();
+
+	std::vector<std::unique_ptr<Visualizer>> vizs;
+	std::vector<Visualizer::Rendition> renditions;
+	for (const auto &spec : get<std::vector<std::string>>("--renditions"))
+	{
+		// <width>x<height>,<fps>,<output_file>[,vcodec[,acodec]]
+		std::vector<std::string> fields;
+		std::istringstream ss(spec);
+		for (std::string field; std::getline(ss, field, ',');)
+			fields.push_back(field);
+		int width, height;
+		if (fields.size() < 3 || fields.size() > 5 || sscanf(fields[0].c_str(), "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0)
+			throw std::invalid_argument("invalid rendition: " + spec);
+
+		auto &viz = *vizs.emplace_back(std::make_unique<Visualizer>(get("audio_file"), width, height, true, assets));
+		configure_analysis(viz);
+		configure_visuals(viz);
+		// every rendition has its own ffmpeg writing to the terminal
+		viz.set_ffmpeg_loglevel("error");
+		renditions.push_back({viz, fields[2], std::atoi(fields[1].c_str()), fields.size() > 3 ? fields[3] : "h264", fields.size() > 4 ? fields[4] : "copy"});
+	}
+
+	// the first rendition's visualizer reads and analyzes the audio for all of them
+	const auto frames = vizs.front()->encode_renditions(renditions);
+	for (size_t i = 0; i < renditions.size(); ++i)
+		std::cout << renditions[i].output_file << ": " << frames[i] << " frames\n";
+}
+
+template <typename T>
+void Main::configure_analysis(T &target)
+{
+	// all of these have default values, no need to try-catch
+	target.set_sample_size(get<uint>("-n"));
+	target.set_multiplier(get<float>("-m"));
+	target.set_mono(get<int>("--mono"));
+	target.set_resolution_bands(get<uint>("--multires"));
+
 	{ // accumulation method
 		const auto &am_str = get("-a");
 		if (am_str == "sum")
-			set_accum_method(FS::AccumulationMethod::SUM);
+			target.set_accum_method(FS::AccumulationMethod::SUM);
 		else if (am_str == "max")
-			set_accum_method(FS::AccumulationMethod::MAX);
+			target.set_accum_method(FS::AccumulationMethod::MAX);
+		else if (am_str == "filterbank")
+			target.set_accum_method(FS::AccumulationMethod::FILTERBANK);
 		else
 			throw std::invalid_argument("unknown accumulation method: " + am_str);
 	}
@@ -45,13 +156,13 @@ Main::Main(const int argc, const char *const *const argv)
 	{ // window function
 		const auto &wf_str = get("-w");
 		if (wf_str == "hanning")
-			set_window_function(FS::WindowFunction::HANNING);
+			target.set_window_function(FS::WindowFunction::HANNING);
 		else if (wf_str == "hamming")
-			set_window_function(FS::WindowFunction::HAMMING);
+			target.set_window_function(FS::WindowFunction::HAMMING);
 		else if (wf_str == "blackman")
-			set_window_function(FS::WindowFunction::BLACKMAN);
+			target.set_window_function(FS::WindowFunction::BLACKMAN);
 		else if (wf_str == "none")
-			set_window_function(FS::WindowFunction::NONE);
+			target.set_window_function(FS::WindowFunction::NONE);
 		else
 			throw std::invalid_argument("unknown window function: " + wf_str);
 	}
@@ -59,72 +170,266 @@ Main::Main(const int argc, const char *const *const argv)
 	{ // interpolation type
 		const auto &interp_str = get("-i");
 		if (interp_str == "none")
-			set_interp_type(FS::InterpolationType::NONE);
+			target.set_interp_type(FS::InterpolationType::NONE);
 		else if (interp_str == "linear")
-			set_interp_type(FS::InterpolationType::LINEAR);
+			target.set_interp_type(FS::InterpolationType::LINEAR);
 		else if (interp_str == "cspline")
-			set_interp_type(FS::InterpolationType::CSPLINE);
+			target.set_interp_type(FS::InterpolationType::CSPLINE);
 		else if (interp_str == "cspline_hermite")
-			set_interp_type(FS::InterpolationType::CSPLINE_HERMITE);
+			target.set_interp_type(FS::InterpolationType::CSPLINE_HERMITE);
 		else
 			throw std::invalid_argument("unknown interpolation type: " + interp_str);
 	}
 
+	// -s, --scale
+	switch (const auto &scale_args = get<std::vector<std::string>>("-s"); scale_args.size())
+	{
+	case 0:
+		break;
+	case 1:
+		if (scale_args[0] == "linear")
+			target.set_scale(FS::Scale::LINEAR);
+		else if (scale_args[0] == "log")
+			target.set_scale(FS::Scale::LOG);
+		else if (scale_args[0] == "nth-root")
+			target.set_scale(FS::Scale::NTH_ROOT);
+		break;
+	case 2:
+		if (scale_args[0] != "nth-root")
+			throw std::invalid_argument("only the 'nth-root' scale takes an additional argument");
+		target.set_nth_root(std::stoi(scale_args[1]));
+	}
+}
+
+std::vector<Main::FS::StereoView> Main::views()
+{
+	std::vector<FS::StereoView> views;
+	if (!is_used("--views"))
+		return views;
+	for (const auto &view : get<std::vector<std::string>>("--views"))
+		if (view == "l")
+			views.push_back({1, 0});
+		else if (view == "r")
+			views.push_back({0, 1});
+		else if (view == "m")
+			views.push_back({0.5, 0.5});
+		else if (view == "s")
+			views.push_back({0.5, -0.5});
+		else
+			throw std::invalid_argument("unknown view: " + view);
+	return views;
+}
+
+void Main::configure_visuals(Visualizer &viz)
+{
+	viz.set_views(views());
+	viz.set_spectrogram(get<bool>("--spectrogram"));
+	if (const auto spans = present<std::vector<float>>("--waveform"))
+		viz.set_waveform(spans.value());
+	if (const auto size = present<uint>("--vectorscope"))
+		viz.set_vectorscope(size.value(), get<float>("--scope-persistence"));
+	viz.set_analysis_rate(get<uint>("--analysis-rate"));
+	viz.set_bar_width(get<uint>("-bw"));
+	viz.set_bar_spacing(get<uint>("-bs"));
+
+	// finally i realized what `present` does
+	// no need to try-catch on `get` anymore...
+
+	if (const auto ffmpeg_path = present("--ffmpeg-path"))
+		viz.set_ffmpeg_path(ffmpeg_path.value());
+
+	if (const auto bg = present("--bg"))
+		viz.set_background(bg.value());
+
+	if (const auto album_art = present("--album-art"))
+		viz.set_album_art(album_art.value());
+
+	{ // analysis engine
+		const auto &engine_str = get("--engine");
+		if (engine_str == "fft")
+			viz.set_analysis_engine(Visualizer::AnalysisEngine::FFT);
+		else if (engine_str == "biquad")
+			viz.set_analysis_engine(Visualizer::AnalysisEngine::BIQUAD);
+		else
+			throw std::invalid_argument("unknown analysis engine: " + engine_str);
+	}
+
+	{ // encode rasterizer; batch jobs, segment workers and renditions are already parallel with each other
+		const auto &rasterizer_str = get("--rasterizer");
+		auto threads = get<uint>("--raster-threads");
+		if (!threads)
+		{
+			threads = batch_assets ? 1 : std::max(1u, std::thread::hardware_concurrency());
+			if (const auto segment = present<std::vector<uint>>("--segment"))
+				threads = std::max(1u, threads / std::min(segment->at(1), get<uint>("-j")));
+			else if (const auto renditions = present<std::vector<std::string>>("--renditions"))
+				threads = std::max(1u, threads / (uint)renditions->size());
+		}
+		if (rasterizer_str == "cpu")
+			viz.set_rasterizer(Visualizer::Rasterizer::CPU, threads);
+		else if (rasterizer_str == "sdl")
+			viz.set_rasterizer(Visualizer::Rasterizer::SDL, threads);
+		else
+			throw std::invalid_argument("unknown rasterizer: " + rasterizer_str);
+	}
+
+	{ // pixel format handed to the encoder
+		const auto &pix_fmt_str = get("--pix-fmt");
+		if (pix_fmt_str == "yuv420p")
+			viz.set_encode_pixel_format(Visualizer::EncodePixelFormat::YUV420P);
+		else if (pix_fmt_str == "nv12")
+			viz.set_encode_pixel_format(Visualizer::EncodePixelFormat::NV12);
+		else if (pix_fmt_str == "rgb")
+			viz.set_encode_pixel_format(Visualizer::EncodePixelFormat::RGB);
+		else
+			throw std::invalid_argument("unknown pixel format: " + pix_fmt_str);
+	}
+
+	{ // encoder backend
+		const auto &encoder_str = get("--encoder");
+		if (encoder_str == "ffmpeg")
+			viz.set_encoder_backend(Visualizer::EncoderBackend::FFMPEG);
+		else if (encoder_str == "libav")
+			viz.set_encoder_backend(Visualizer::EncoderBackend::LIBAV);
+		else
+			throw std::invalid_argument("unknown encoder: " + encoder_str);
+	}
+
+	{ // layout
+		const auto &layout_str = get("--layout");
+		if (layout_str == "grid")
+			viz.set_layout(Visualizer::Layout::GRID);
+		else if (layout_str == "stacked")
+			viz.set_layout(Visualizer::Layout::STACKED);
+		else if (layout_str == "radial")
+			viz.set_layout(Visualizer::Layout::RADIAL);
+		else
+			throw std::invalid_argument("unknown layout: " + layout_str);
+	}
+
+	{ // bar type
+		const auto &bt_str = get("-bt");
+		if (bt_str == "bar")
+			viz.set_bar_type(SR::BarType::RECTANGLE);
+		else if (bt_str == "pill")
+			viz.set_bar_type(SR::BarType::PILL);
+		else
+			throw std::invalid_argument("unknown bar type: " + bt_str);
+	}
+
 	{ // spectrum coloring type
 		const auto &color_str = get("--color");
 		if (color_str == "wheel")
 		{
-			set_color_mode(SR::ColorMode::WHEEL);
+			viz.set_color_mode(SR::ColorMode::WHEEL);
 			const auto &hsv = get<std::vector<float>>("--hsv");
 			assert(hsv.size() == 3);
-			set_color_wheel_hsv({hsv[0], hsv[1], hsv[2]});
-			set_color_wheel_rate(get<float>("--wheel-rate"));
+			viz.set_color_wheel_hsv({hsv[0], hsv[1], hsv[2]});
+			viz.set_color_wheel_rate(get<float>("--wheel-rate"));
 		}
 		else if (color_str == "solid")
 		{
-			set_color_mode(SR::ColorMode::SOLID);
+			viz.set_color_mode(SR::ColorMode::SOLID);
 			const auto &rgb = get<std::vector<Uint16>>("--rgb");
-			set_color_solid_rgb({rgb[0], rgb[1], rgb[2]});
+			viz.set_color_solid_rgb({rgb[0], rgb[1], rgb[2]});
 		}
 		else
 			throw std::invalid_argument("unknown coloring type: " + color_str);
 	}
+}
 
-	// -s, --scale
-	switch (const auto &scale_args = get<std::vector<std::string>>("-s"); scale_args.size())
+void Main::dump_spectrum(const std::string &output_file)
+{
+	SpectrumDumper dumper(get("audio_file"));
+	configure_analysis(dumper);
+	dumper.set_bars(get<uint>("--bars"));
+	dumper.set_frame_rate(get<uint>("--dump-fps"));
+	dumper.set_views(views());
+
+	{ // dump format: explicit, or inferred from the file extension
+		const auto format_str = present("--dump-format").value_or(output_file.ends_with(".npy") ? "npy" : "raw");
+		if (format_str == "raw")
+			dumper.set_format(SpectrumDumper::Format::RAW);
+		else if (format_str == "npy")
+			dumper.set_format(SpectrumDumper::Format::NPY);
+		else
+			throw std::invalid_argument("unknown dump format: " + format_str);
+	}
+
+	{ // dump sample type
+		const auto &type_str = get("--dump-type");
+		if (type_str == "f32")
+			dumper.set_sample_format(SpectrumDumper::SampleFormat::FLOAT32);
+		else if (type_str == "u16")
+			dumper.set_sample_format(SpectrumDumper::SampleFormat::UINT16);
+		else
+			throw std::invalid_argument("unknown dump sample type: " + type_str);
+	}
+
+	dumper.dump(output_file);
+}
+
+void Main::visualize()
+{
+	if (batch_assets)
 	{
-	case 0:
-		break;
-	case 1:
-		if (scale_args[0] == "linear")
-			set_scale(FS::Scale::LINEAR);
-		else if (scale_args[0] == "log")
-			set_scale(FS::Scale::LOG);
-		else if (scale_args[0] == "nth-root")
-			set_scale(FS::Scale::NTH_ROOT);
-		break;
-	case 2:
-		if (scale_args[0] != "nth-root")
-			throw std::invalid_argument("only the 'nth-root' scale takes an additional argument");
-		set_nth_root(std::stoi(scale_args[1]));
+		Visualizer viz(get("audio_file"), get<uint>("--width"), get<uint>("--height"), true, batch_assets);
+		// many jobs share the terminal; only let ffmpeg speak up when something goes wrong
+		viz.set_ffmpeg_loglevel("error");
+		render(viz);
+		return;
+	}
+
+	// segment workers render headless too, and share the terminal the same way
+	if (is_used("--segment"))
+	{
+		SDL2pp::SDL sdl(0);
+		SDL2pp::SDLTTF ttf;
+		Visualizer viz(get("audio_file"), get<uint>("--width"), get<uint>("--height"), true);
+		viz.set_ffmpeg_loglevel("error");
+		render(viz);
+		return;
+	}
+
+	setenv("SDL_VIDEODRIVER", "wayland", 1);
+	SDL2pp::SDL sdl(SDL_INIT_VIDEO);
+	SDL2pp::SDLTTF ttf;
+
+	Visualizer viz(get("audio_file"), get<uint>("--width"), get<uint>("--height"));
+	render(viz);
+}
+
+void Main::render(Visualizer &viz)
+{
+	configure_analysis(viz);
+	configure_visuals(viz);
+
+	const auto &encode_args = get<std::vector<std::string>>("--encode");
+	auto output_file = encode_args.empty() ? "" : encode_args[0];
+
+	// --segment (this process encodes one segment for `run_segments`)
+	if (const auto segment = present<std::vector<uint>>("--segment"))
+	{
+		viz.set_encode_segment(segment->at(0), segment->at(1));
+		output_file = SegmentedEncode::segment_file(output_file, segment->at(0));
 	}
 
 	// --encode (decides whether we render to the window or to a video)
-	switch (const auto &encode_args = get<std::vector<std::string>>("--encode"); encode_args.size())
+	switch (encode_args.size())
 	{
 	case 0:
-		start();
+		viz.start();
 		break;
 	case 2:
-		encode_to_video(encode_args[0], std::atoi(encode_args[1].c_str()));
+		viz.encode_to_video(output_file, std::atoi(encode_args[1].c_str()));
 		break;
 	case 3:
-		encode_to_video(encode_args[0], std::atoi(encode_args[1].c_str()), encode_args[2]);
+		viz.encode_to_video(output_file, std::atoi(encode_args[1].c_str()), encode_args[2]);
 		break;
 	case 4:
-		encode_to_video(encode_args[0], std::atoi(encode_args[1].c_str()), encode_args[2], encode_args[3]);
+		viz.encode_to_video(output_file, std::atoi(encode_args[1].c_str()), encode_args[2], encode_args[3]);
 		break;
 	default:
 		throw std::logic_error("--encode should only have 2-4 arguments");
 	}
-}
\ No newline at end of file
+}
@@ -3,6 +3,17 @@
 MyRenderer::MyRenderer(SDL2pp::Window &window, Uint32 flags)
 	: SDL2pp::Renderer(window, -1, flags), _r(Get()) {}
 
+// SDL2pp::Renderer doesn't check the pointer it is given
+static SDL_Renderer *check_renderer(SDL_Renderer *const renderer)
+{
+	if (!renderer)
+		throw SDL2pp::Exception("SDL_CreateRenderer");
+	return renderer;
+}
+
+MyRenderer::MyRenderer(SDL_Renderer *const renderer)
+	: SDL2pp::Renderer(check_renderer(renderer)), _r(Get()) {}
+
 void MyRenderer::drawBoxCentered(Sint16 x, Sint16 y, Sint16 w, Sint16 h, Uint8 r, Uint8 g, Uint8 b, Uint8 a)
 {
 	if (w <= 0 || h <= 0)
@@ -0,0 +1,90 @@
+#include "PeakPyramid.hpp"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+PeakPyramid::PeakPyramid(const long expected_samples, const int finest_level)
+	: finest_level(finest_level)
+{
+	if (finest_level < 0 || finest_level >= max_levels)
+		throw std::invalid_argument("PeakPyramid: finest_level must be in [0, max_levels)");
+	auto block = (long)base_block;
+	for (int l = 0; l < max_levels; ++l, block *= factor)
+		if (l >= finest_level)
+			levels[l].reserve(expected_samples / block + 1);
+}
+
+int PeakPyramid::level_for(const double samples_per_pixel)
+{
+	int level = 0;
+	for (auto block = (double)base_block * factor; level + 1 < max_levels && block <= samples_per_pixel; block *= factor)
+		++level;
+	return level;
+}
+
+void PeakPyramid::push(const int level, const Peak peak)
+{
+	if (level >= finest_level)
+		levels[level].push_back(peak);
+	if (level + 1 == max_levels)
+		return;
+
+	auto &above = pending[level + 1];
+	above = pending_count[level + 1]++ ? Peak{std::min(above.min, peak.min), std::max(above.max, peak.max)} : peak;
+	if (pending_count[level + 1] == factor)
+	{
+		pending_count[level + 1] = 0;
+		push(level + 1, above);
+	}
+}
+
+void PeakPyramid::append(const float *const audio, const int frames, const int channels)
+{
+	auto &peak = pending[0];
+	auto &count = pending_count[0];
+	for (int i = 0; i < frames; ++i)
+	{
+		float sample = 0;
+		for (int c = 0; c < channels; ++c)
+			sample += audio[i * channels + c];
+		sample /= channels;
+
+		peak = count++ ? Peak{std::min(peak.min, sample), std::max(peak.max, sample)} : Peak{sample, sample};
+		if (count == base_block)
+		{
+			count = 0;
+			push(0, peak);
+		}
+	}
+	samples += frames;
+}
+
+void PeakPyramid::query(const double first, const double samples_per_pixel, const std::span<Peak> out) const
+{
+	// the coarsest level at most a pixel wide: each pixel spans fewer than `factor + 1` of its peaks
+	const auto level = std::max(level_for(samples_per_pixel), finest_level);
+	const auto block = base_block * std::pow((double)factor, level);
+	const auto &peaks = levels[level];
+
+	for (size_t i = 0; i < out.size(); ++i)
+	{
+		// every peak overlapping the pixel, so that no extreme is missed
+		const auto start = (long)std::floor((first + i * samples_per_pixel) / block),
+				   end = std::max(start + 1, (long)std::ceil((first + (i + 1) * samples_per_pixel) / block));
+		Peak peak{0, 0};
+		bool any = false;
+		const auto add = [&](const Peak &p)
+		{
+			peak = any ? Peak{std::min(peak.min, p.min), std::max(peak.max, p.max)} : p;
+			any = true;
+		};
+		for (auto b = std::max(start, 0l); b < std::min(end, (long)peaks.size()); ++b)
+			add(peaks[b]);
+		// the audio after the last complete peak is still pending at this level and the ones below
+		if (start <= (long)peaks.size() && end > (long)peaks.size())
+			for (int l = 0; l <= level; ++l)
+				if (pending_count[l])
+					add(pending[l]);
+		out[i] = peak;
+	}
+}
@@ -0,0 +1,202 @@
+#include "SegmentedEncode.hpp"
+#include <sys/wait.h>
+#include <unistd.h>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+
+namespace fs = std::filesystem;
+
+// validates `count` before it sizes `done`
+static int segment_count(const int count)
+{
+	if (count <= 0)
+		throw std::invalid_argument("SegmentedEncode: count must be positive");
+	return count;
+}
+
+SegmentedEncode::SegmentedEncode(const std::string &output_file, const int count, const std::vector<std::string> &args)
+	: output_file(output_file),
+	  directory(output_file + ".segments"),
+	  manifest(directory + "/manifest"),
+	  count(segment_count(count)),
+	  args(args),
+	  done(count)
+{
+	read_manifest();
+}
+
+std::string SegmentedEncode::segment_file(const std::string &output_file, const int index)
+{
+	std::ostringstream ss;
+	ss << "segment-" << std::setw(4) << std::setfill('0') << index << fs::path(output_file).extension().string();
+	return output_file + ".segments/" + ss.str();
+}
+
+std::string SegmentedEncode::manifest_header() const
+{
+	// quoted like a batch manifest line, so that arguments with spaces compare exactly
+	std::string header = "# audioviz segments " + std::to_string(count) + ":";
+	for (const auto &arg : args)
+		header += " '" + arg + '\'';
+	return header;
+}
+
+void SegmentedEncode::read_manifest()
+{
+	const auto header = manifest_header();
+	if (std::ifstream in(manifest); in)
+	{
+		std::string line;
+		if (std::getline(in, line) && line == header)
+		{
+			// one `done <index>` line per finished segment. a last line cut short by a crash lacks its newline
+			for (int index; std::getline(in, line) && !in.eof();)
+				if (sscanf(line.c_str(), "done %d", &index) == 1 && index >= 0 && index < count && fs::exists(segment_file(output_file, index)))
+					done[index] = true;
+			return;
+		}
+		std::cerr << "SegmentedEncode: " << manifest << " was recorded with other arguments, starting over\n";
+	}
+
+	std::error_code ec;
+	fs::remove_all(directory, ec);
+	if (!fs::create_directories(directory, ec) && ec)
+		throw std::runtime_error("SegmentedEncode: cannot create " + directory + ": " + ec.message());
+	std::ofstream out(manifest);
+	if (!(out << header << '\n'))
+		throw std::runtime_error("SegmentedEncode: cannot write " + manifest);
+}
+
+void SegmentedEncode::record(const int index)
+{
+	std::ofstream out(manifest, std::ios::app);
+	if (!(out << "done " << index << '\n' << std::flush))
+		throw std::runtime_error("SegmentedEncode: cannot write " + manifest);
+	done[index] = true;
+}
+
+int SegmentedEncode::run(const char *const program, const int concurrency)
+{
+	using clock = std::chrono::steady_clock;
+
+	std::vector<int> pending;
+	for (int i = count - 1; i >= 0; --i)
+		if (!done[i])
+			pending.push_back(i);
+	if ((int)pending.size() < count)
+		std::cerr << "SegmentedEncode: resuming, " << count - pending.size() << '/' << count << " segment(s) already done\n";
+
+	// built before forking: only `execv` runs in the child
+	std::vector<std::string> worker_args{program};
+	worker_args.insert(worker_args.end(), args.begin(), args.end());
+	worker_args.insert(worker_args.end(), {"--segment", "", std::to_string(count)});
+	const auto index_arg = worker_args.size() - 2;
+
+	struct Worker
+	{
+		int index;
+		clock::time_point start;
+	};
+	std::map<pid_t, Worker> running;
+	int failed = 0;
+
+	const auto describe = [&](const int index)
+	{
+		return "[segment " + std::to_string(index + 1) + "/" + std::to_string(count) + "]";
+	};
+
+	while (!pending.empty() || !running.empty())
+	{
+		while (!pending.empty() && (int)running.size() < std::max(concurrency, 1))
+		{
+			const auto index = pending.back();
+			pending.pop_back();
+			worker_args[index_arg] = std::to_string(index);
+			std::vector<char *> argv;
+			for (auto &arg : worker_args)
+				argv.push_back(arg.data());
+			argv.push_back(nullptr);
+
+			const auto pid = fork();
+			if (pid == -1)
+				throw std::runtime_error(std::string("fork: ") + strerror(errno));
+			if (!pid)
+			{
+				// this very executable, wherever it was run from
+				execv("/proc/self/exe", argv.data());
+				_exit(127);
+			}
+			running[pid] = {index, clock::now()};
+			std::cerr << describe(index) << ": started\n";
+		}
+
+		int status;
+		const auto pid = waitpid(-1, &status, 0);
+		if (pid == -1)
+			throw std::runtime_error(std::string("waitpid: ") + strerror(errno));
+		const auto worker = running.find(pid);
+		if (worker == running.end())
+			continue;
+		const auto [index, start] = worker->second;
+		running.erase(worker);
+		const std::chrono::duration<double> elapsed = clock::now() - start;
+
+		if (WIFEXITED(status) && !WEXITSTATUS(status))
+		{
+			record(index);
+			std::cerr << describe(index) << ": done in " << elapsed.count() << " s\n";
+		}
+		else
+		{
+			++failed;
+			std::cerr << describe(index) << ": FAILED after " << elapsed.count() << " s: "
+					  << (WIFEXITED(status) ? "exit status " + std::to_string(WEXITSTATUS(status)) : std::string("killed by ") + strsignal(WTERMSIG(status))) << '\n';
+		}
+	}
+
+	return failed;
+}
+
+void SegmentedEncode::concat(const std::string &ffmpeg_path, const std::string &audio_file, const std::string &acodec)
+{
+	const auto list = directory + "/concat.txt";
+	{
+		std::ofstream out(list);
+		for (int i = 0; i < count; ++i)
+		{
+			if (!done[i])
+				throw std::logic_error("SegmentedEncode::concat: segment " + std::to_string(i) + " is not done");
+			// relative to the list's own directory
+			out << "file '" << fs::path(segment_file(output_file, i)).filename().string() << "'\n";
+		}
+		if (!out)
+			throw std::runtime_error("SegmentedEncode: cannot write " + list);
+	}
+
+	// segments start at exact frame boundaries, so the audio needs no offset
+	std::ostringstream ss;
+	ss << '\'' << ffmpeg_path << "' -hide_banner -y -f concat -safe 0 -i '" << list
+	   << "' -i '" << audio_file
+	   << "' -map 0:v -map 1:a -c:v copy -c:a " << acodec
+	   << " -shortest '" << output_file << '\'';
+	const auto command = ss.str();
+	std::cout << command << '\n';
+
+	if (const auto status = std::system(command.c_str()); status == -1)
+		throw std::runtime_error(std::string("system: ") + strerror(errno));
+	else if (status)
+		throw std::runtime_error(ffmpeg_path + " exited with status " + std::to_string(WEXITSTATUS(status)) + "; segments are kept in " + directory);
+
+	std::error_code ec;
+	fs::remove_all(directory, ec);
+}
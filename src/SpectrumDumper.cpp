@@ -0,0 +1,159 @@
+#include "SpectrumDumper.hpp"
+#include "StageCounters.hpp"
+#include <bit>
+#include <cerrno>
+#include <cmath>
+#include <stdexcept>
+
+static_assert(std::endian::native == std::endian::little, "SpectrumDumper's output formats are little-endian");
+
+SpectrumDumper::SpectrumDumper(const std::string &audio_file)
+	: sf(audio_file)
+{
+	if (sf.error())
+		throw std::runtime_error(audio_file + ": " + sf.strError());
+}
+
+template <typename T>
+static void write_value(FILE *const out, const T value)
+{
+	if (fwrite(&value, sizeof(T), 1, out) != 1)
+		throw std::runtime_error(std::string("fwrite: ") + strerror(errno));
+}
+
+void SpectrumDumper::write_header(FILE *const out, const int frames)
+{
+	switch (format)
+	{
+	case Format::RAW:
+		if (fwrite("AVZS", 1, 4, out) != 4)
+			throw std::runtime_error(std::string("fwrite: ") + strerror(errno));
+		write_value<uint16_t>(out, 1);
+		write_value<uint16_t>(out, sample_format == SampleFormat::FLOAT32 ? 0 : 1);
+		write_value<uint32_t>(out, output_channels());
+		write_value<uint32_t>(out, bars);
+		write_value<uint32_t>(out, frames);
+		write_value<float>(out, frame_rate);
+		write_value<uint32_t>(out, sf.samplerate());
+		write_value<uint32_t>(out, sample_size);
+		break;
+
+	case Format::NPY:
+	{
+		auto dict = std::string("{'descr': '") + (sample_format == SampleFormat::FLOAT32 ? "<f4" : "<u2") +
+					"', 'fortran_order': False, 'shape': (" + std::to_string(frames) + ", " +
+					std::to_string(output_channels()) + ", " + std::to_string(bars) + "), }";
+		// magic (6) + version (2) + header length (2) + dict must be padded to a multiple of 64, ending in a newline
+		dict.append(63 - (10 + dict.size()) % 64, ' ').push_back('\n');
+		if (fwrite("\x93NUMPY\x01\x00", 1, 8, out) != 8)
+			throw std::runtime_error(std::string("fwrite: ") + strerror(errno));
+		write_value<uint16_t>(out, dict.size());
+		if (fwrite(dict.data(), 1, dict.size(), out) != dict.size())
+			throw std::runtime_error(std::string("fwrite: ") + strerror(errno));
+		break;
+	}
+
+	default:
+		throw std::logic_error("SpectrumDumper::write_header: default case hit");
+	}
+}
+
+int SpectrumDumper::dump(const std::string &output_file)
+{
+	const bool to_stdout = output_file == "-";
+	const auto out = to_stdout ? stdout : fopen(output_file.c_str(), "wb");
+	if (!out)
+		throw std::runtime_error(output_file + ": " + strerror(errno));
+
+	// we write in small chunks, so a big buffer saves a lot of syscalls
+	setvbuf(out, NULL, _IOFBF, 1 << 20);
+
+	const auto channels = sf.channels();
+	// channels transformed together in one batched fft; audio with more than an analysis supports is transformed one channel at a time
+	const auto batched = views.size() ? 2 : mono < 0 && channels <= FS::max_channels ? channels : 1;
+	fs.set_channels(batched);
+	fs.commit();
+
+	const auto hop = sf.samplerate() / frame_rate;
+	const int frames = sf.frames() < sample_size ? 0 : (sf.frames() - sample_size) / hop + 1;
+
+	write_header(out, frames);
+
+	std::vector<float> audio_buffer(sample_size * channels), spectrum(bars), frame_f32(output_channels() * bars);
+	std::vector<uint16_t> frame_u16(frame_f32.size());
+	FS::Bins view_bins;
+
+	sf.seek(0, SEEK_SET);
+	if (frames && sf.readf(audio_buffer.data(), sample_size) != sample_size)
+		throw std::runtime_error("SpectrumDumper::dump: short read");
+
+	for (int frame = 0; frame < frames; ++frame)
+	{
+		if (batched == 1)
+			for (int c = 0; c < output_channels(); ++c)
+			{
+				fs.copy_channel_to_input(audio_buffer.data(), channels, mono < 0 ? c : mono, true);
+				fs.render(spectrum);
+				std::ranges::copy(spectrum, frame_f32.begin() + c * bars);
+			}
+		else
+		{
+			// all channels in one transform, however many views are mixed from them
+			fs.copy_channels_to_input(audio_buffer.data(), channels);
+			fs.transform();
+			for (int c = 0; c < output_channels(); ++c)
+			{
+				if (views.empty())
+					fs.render(fs.bins(c), spectrum);
+				else
+				{
+					FS::mix(fs.bins(0), views[c].left, fs.bins(1), views[c].right, view_bins);
+					fs.render(view_bins, spectrum);
+				}
+				std::ranges::copy(spectrum, frame_f32.begin() + c * bars);
+			}
+		}
+
+		switch (sample_format)
+		{
+		case SampleFormat::FLOAT32:
+			if (fwrite(frame_f32.data(), sizeof(float), frame_f32.size(), out) != frame_f32.size())
+				throw std::runtime_error(std::string("fwrite: ") + strerror(errno));
+			break;
+
+		case SampleFormat::UINT16:
+			for (size_t i = 0; i < frame_f32.size(); ++i)
+				frame_u16[i] = std::round(std::clamp(multiplier * frame_f32[i], 0.f, 1.f) * 65535);
+			if (fwrite(frame_u16.data(), sizeof(uint16_t), frame_u16.size(), out) != frame_u16.size())
+				throw std::runtime_error(std::string("fwrite: ") + strerror(errno));
+			break;
+
+		default:
+			throw std::logic_error("SpectrumDumper::dump: switch(sample_format): default case hit");
+		}
+
+		StageCounters::end_frame();
+
+		if (frame == frames - 1)
+			break;
+
+		// advance the analysis window by one hop, reusing the overlapping samples instead of re-reading them
+		if (hop < sample_size)
+		{
+			std::copy(audio_buffer.begin() + hop * channels, audio_buffer.end(), audio_buffer.begin());
+			if (sf.readf(audio_buffer.data() + (sample_size - hop) * channels, hop) != hop)
+				throw std::runtime_error("SpectrumDumper::dump: short read");
+		}
+		else
+		{
+			sf.seek(hop - sample_size, SEEK_CUR);
+			if (sf.readf(audio_buffer.data(), sample_size) != sample_size)
+				throw std::runtime_error("SpectrumDumper::dump: short read");
+		}
+	}
+
+	if (to_stdout ? fflush(out) : fclose(out))
+		throw std::runtime_error(std::string("fclose: ") + strerror(errno));
+
+	return frames;
+}
@@ -0,0 +1,81 @@
+#include "SpectrumDumper.hpp"
+#include <stdexcept>
+
+void SpectrumDumper::set_sample_size(const int sample_size)
+{
+	this->sample_size = sample_size;
+	fs.set_fft_size(sample_size);
+}
+
+void SpectrumDumper::set_mono(const int mono)
+{
+	if (mono >= sf.channels())
+		throw std::invalid_argument("SpectrumDumper::set_mono: channel out of range");
+	this->mono = mono;
+}
+
+void SpectrumDumper::set_views(const std::vector<FS::StereoView> &views)
+{
+	if (!views.empty() && sf.channels() != 2)
+		throw std::invalid_argument("SpectrumDumper::set_views: views require stereo audio");
+	this->views = views;
+}
+
+void SpectrumDumper::set_multiplier(const float multiplier)
+{
+	this->multiplier = multiplier;
+}
+
+void SpectrumDumper::set_interp_type(const FS::InterpolationType interp_type)
+{
+	fs.set_interp_type(interp_type);
+}
+
+void SpectrumDumper::set_scale(const FS::Scale scale)
+{
+	fs.set_scale(scale);
+}
+
+void SpectrumDumper::set_nth_root(const int nth_root)
+{
+	fs.set_nth_root(nth_root);
+}
+
+void SpectrumDumper::set_resolution_bands(const int bands)
+{
+	fs.set_resolution_bands(bands);
+}
+
+void SpectrumDumper::set_accum_method(const FS::AccumulationMethod method)
+{
+	fs.set_accum_method(method);
+}
+
+void SpectrumDumper::set_window_function(const FS::WindowFunction wf)
+{
+	fs.set_window_func(wf);
+}
+
+void SpectrumDumper::set_bars(const int bars)
+{
+	if (bars <= 0)
+		throw std::invalid_argument("SpectrumDumper::set_bars: bars must be positive");
+	this->bars = bars;
+}
+
+void SpectrumDumper::set_frame_rate(const int frame_rate)
+{
+	if (frame_rate <= 0)
+		throw std::invalid_argument("SpectrumDumper::set_frame_rate: frame_rate must be positive");
+	this->frame_rate = frame_rate;
+}
+
+void SpectrumDumper::set_format(const Format format)
+{
+	this->format = format;
+}
+
+void SpectrumDumper::set_sample_format(const SampleFormat sample_format)
+{
+	this->sample_format = sample_format;
+}
@@ -1,39 +1,36 @@
 #include "SpectrumRenderer.hpp"
+#include <algorithm>
+#include <cmath>
 
 void SpectrumRenderer::copy_channel_to_input(const float *audio, int num_channels, int channel, bool interleaved)
 {
 	fs.copy_channel_to_input(audio, num_channels, channel, interleaved);
 }
 
+std::unique_ptr<FrequencySpectrum::Config> SpectrumRenderer::swap_analysis_config(std::unique_ptr<FS::Config> config)
+{
+	return fs.swap_config(std::move(config));
+}
+
 void SpectrumRenderer::render_spectrum(const SDL2pp::Rect &rect, const bool backwards)
 {
 	// resize spectrum first! this is the old formula, except now it's relative to the passed in rect.
 	// this makes things much much more flexible
-	spectrum.resize(rect.w / (bar.width + bar.spacing));
+	spectrum.resize(bar_count(rect));
 
 	// render spectrum
-	fs.render(spectrum);
+	analyze(spectrum);
+	draw_spectrum(spectrum, rect, backwards);
+}
 
-	for (int i = 0; i < (int)spectrum.size(); ++i)
+void SpectrumRenderer::draw_spectrum(const std::vector<float> &spectrum, const SDL2pp::Rect &rect, const bool backwards)
+{
+	for_each_bar(spectrum, rect, backwards, [&](const int x, const int h, const Uint8 r, const Uint8 g, const Uint8 b)
 	{
-		const auto [r, g, b] = color.get((float)i / spectrum.size());
-		const auto x = backwards ? (rect.GetBottomRight().x - bar.width - i * (bar.width + bar.spacing))
-								 : (rect.x + i * (bar.width + bar.spacing));
-		const auto h = std::max(
-			1.f, // must max with 1 because MyRenderer::drawXFromBottomLeft only allows positive dimensions
-				 // and, we want to see the bars at all times
-			round(
-				std::min(
-					(float)rect.h,
-					multiplier * std::max(0.f, spectrum[i]) * rect.h
-				)
-			)
-		);
-
 		if (bar.width == 1)
 		{
 			vlineRGBA(_r, x, rect.y + rect.h - h, rect.y + rect.h, r, g, b, 255);
-			continue;
+			return;
 		}
 
 		switch (bar.type)
@@ -45,9 +42,153 @@ void SpectrumRenderer::render_spectrum(const SDL2pp::Rect &rect, const bool back
 			drawPillFromBottomLeft(x, rect.y + rect.h - 1, bar.width, h, r, g, b, 255);
 			break;
 		default:
-			throw std::logic_error("SpectrumRenderer::render_spectrum: switch(bar.type): default case hit");
+			throw std::logic_error("SpectrumRenderer::draw_spectrum: switch(bar.type): default case hit");
+		}
+	});
+}
+
+void SpectrumRenderer::draw_spectrum(const std::vector<float> &spectrum, const SDL2pp::Rect &rect, const bool backwards, FrameRasterizer &target)
+{
+	// the same calls as above, with SDL2_gfx's inclusive box corners spelled out
+	for_each_bar(spectrum, rect, backwards, [&](const int x, const int h, const Uint8 r, const Uint8 g, const Uint8 b)
+	{
+		const auto bottom = rect.y + rect.h - 1;
+		if (bar.width == 1)
+		{
+			target.box(x, bottom + 1 - h, x, bottom + 1, r, g, b);
+			return;
 		}
+
+		switch (bar.type)
+		{
+		case BarType::RECTANGLE:
+			target.box(x, bottom - h, x + bar.width - 1, bottom, r, g, b);
+			break;
+		case BarType::PILL:
+			target.pill_from_bottom_left(x, bottom, bar.width, h, r, g, b);
+			break;
+		default:
+			throw std::logic_error("SpectrumRenderer::draw_spectrum: switch(bar.type): default case hit");
+		}
+	});
+}
+
+void SpectrumRenderer::update_spectrogram_lut()
+{
+	const auto key = std::make_tuple(color.mode, color.solid_rgb, color.wheel.hsv);
+	if (spectrogram_lut_key == key)
+		return;
+	spectrogram_lut_key = key;
+
+	const auto [h, s, v] = color.wheel.hsv;
+	const auto [sr, sg, sb] = color.solid_rgb;
+	for (int level = 0; level < (int)spectrogram_lut.size(); ++level)
+	{
+		// from black at silence; with the wheel, loud levels also shift half way around it
+		const auto t = (float)level / (spectrogram_lut.size() - 1);
+		uint8_t r, g, b;
+		switch (color.mode)
+		{
+		case ColorMode::WHEEL:
+			std::tie(r, g, b) = ColorUtils::hsvToRgb(h + t / 2, s, v * t);
+			break;
+		case ColorMode::SOLID:
+			r = sr * t, g = sg * t, b = sb * t;
+			break;
+		default:
+			throw std::logic_error("SpectrumRenderer::update_spectrogram_lut: switch(color.mode): default case hit");
+		}
+		spectrogram_lut[level] = 0xff000000 | r << 16 | g << 8 | b;
+	}
+}
+
+bool SpectrumRenderer::scroll_spectrogram(const std::vector<float> &spectrum, const int rows, const int index)
+{
+	auto &history = histories.at(index);
+	const int bars = spectrum.size();
+	if (!bars || rows <= 0)
+		return false;
+
+	if (!history.texture || history.bars != bars || history.rows != rows)
+	{
+		history.texture.emplace(*this, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, bars, rows);
+		history.texture->SetBlendMode(SDL_BLENDMODE_NONE);
+		const std::vector<uint32_t> black((size_t)bars * rows, 0xff000000);
+		history.texture->Update(SDL2pp::NullOpt, black.data(), bars * sizeof(uint32_t));
+		history.bars = bars;
+		history.rows = rows;
+		history.head = rows - 1;
+		history.row.resize(bars);
+	}
+
+	// the newest row, with the bars' amplitude scaling, overwrites the oldest
+	update_spectrogram_lut();
+	for (int i = 0; i < bars; ++i)
+		history.row[i] = spectrogram_lut[(int)(std::clamp(multiplier * spectrum[i], 0.f, 1.f) * (spectrogram_lut.size() - 1) + .5f)];
+	history.head = (history.head + 1) % history.rows;
+	history.texture->Update(SDL2pp::Rect(0, history.head, bars, 1), history.row.data(), bars * sizeof(uint32_t));
+	return true;
+}
+
+void SpectrumRenderer::draw_spectrogram(const std::vector<float> &spectrum, const SDL2pp::Rect &rect, const bool backwards, const int index)
+{
+	if (!scroll_spectrogram(spectrum, rect.h, index))
+		return;
+	auto &history = histories[index];
+	const auto bars = history.bars;
+
+	// the rows after the head are the oldest, so they go on top
+	const int width = bars * (bar.width + bar.spacing);
+	const auto x = backwards ? rect.GetBottomRight().x + 1 - width : rect.x;
+	const auto flip = backwards ? SDL_FLIP_HORIZONTAL : SDL_FLIP_NONE;
+	const auto older = history.rows - 1 - history.head;
+	if (older)
+		Copy(*history.texture, SDL2pp::Rect(0, history.head + 1, bars, older), SDL2pp::Rect(x, rect.y, width, older), 0, SDL2pp::NullOpt, flip);
+	Copy(*history.texture, SDL2pp::Rect(0, 0, bars, history.head + 1), SDL2pp::Rect(x, rect.y + older, width, history.head + 1), 0, SDL2pp::NullOpt, flip);
+}
+
+void SpectrumRenderer::draw_radial_spectrum(const std::vector<float> &spectrum, const SDL2pp::Point &center, const int radius, const int length, const float start, const float sweep, const int index)
+{
+	auto &table = radial_tables.at(index);
+	const int bars = spectrum.size();
+	if (table.bars != bars || table.start != start || table.sweep != sweep)
+	{
+		table.bars = bars;
+		table.start = start;
+		table.sweep = sweep;
+		table.directions.resize(bars);
+		table.indices.resize(6 * bars);
+		for (int i = 0; i < bars; ++i)
+		{
+			// each bar in the middle of its share of the arc
+			const auto angle = start + sweep * (i + .5f) / bars;
+			table.directions[i] = {std::cos(angle), std::sin(angle)};
+			const int quad[]{0, 1, 2, 0, 2, 3};
+			for (int k = 0; k < 6; ++k)
+				table.indices[6 * i + k] = 4 * i + quad[k];
+		}
+	}
+
+	// only allocates when the number of bars grows
+	radial_vertices.resize(4 * bars);
+	const auto half_width = bar.width / 2.f;
+	for (int i = 0; i < bars; ++i)
+	{
+		const auto [r, g, b] = color.get((float)i / bars);
+		const SDL_Color rgba{r, g, b, 255};
+		const auto [dx, dy] = table.directions[i];
+		// along the bar, and across it by half its width
+		const auto h = radius + bar_height(spectrum[i], length);
+		const auto px = -dy * half_width, py = dx * half_width;
+		const auto bx = center.x + dx * radius, by = center.y + dy * radius,
+				   tx = center.x + dx * h, ty = center.y + dy * h;
+		const auto v = &radial_vertices[4 * i];
+		v[0] = {{bx - px, by - py}, rgba, {}};
+		v[1] = {{bx + px, by + py}, rgba, {}};
+		v[2] = {{tx + px, ty + py}, rgba, {}};
+		v[3] = {{tx - px, ty - py}, rgba, {}};
 	}
+	SDL_RenderGeometry(_r, nullptr, radial_vertices.data(), radial_vertices.size(), table.indices.data(), table.indices.size());
 
 	color.wheel.increment();
 }
@@ -25,6 +25,11 @@ void SpectrumRenderer::set_nth_root(const int nth_root)
 	fs.set_nth_root(nth_root);
 }
 
+void SpectrumRenderer::set_resolution_bands(const int bands)
+{
+	fs.set_resolution_bands(bands);
+}
+
 void SpectrumRenderer::set_accum_method(const FS::AccumulationMethod method)
 {
 	fs.set_accum_method(method);
@@ -33,4 +38,8 @@ void SpectrumRenderer::set_accum_method(const FS::AccumulationMethod method)
 void SpectrumRenderer::set_window_func(const FS::WindowFunction wf)
 {
 	fs.set_window_func(wf);
+}
+void SpectrumRenderer::commit_analysis()
+{
+	fs.commit();
 }
\ No newline at end of file
@@ -0,0 +1,145 @@
+#ifdef AUDIOVIZ_PERF_COUNTERS
+
+#include "StageCounters.hpp"
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+
+static const uint64_t counter_events[]{PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+static const char *const stage_names[]{"window", "fft", "binning", "interpolation", "draw", "readback", "convert"};
+static_assert(std::size(stage_names) == (size_t)StageCounters::Stage::COUNT);
+
+// totals of all threads, per stage
+static struct
+{
+	std::atomic<uint64_t> calls, ns, counters[std::size(counter_events)];
+} totals[(int)StageCounters::Stage::COUNT];
+static std::atomic<uint64_t> frames;
+
+// cleared as soon as any thread fails to open its counters, since totals would then be missing that thread's share
+static std::atomic<bool> hardware = true;
+
+// the calling thread's counters, in one group so that they are read together in a single `read`
+class CounterGroup
+{
+	int fds[std::size(counter_events)];
+
+public:
+	bool open = true;
+
+	CounterGroup()
+	{
+		std::ranges::fill(fds, -1);
+		for (size_t i = 0; i < std::size(counter_events); ++i)
+		{
+			perf_event_attr attr{};
+			attr.size = sizeof(attr);
+			attr.type = PERF_TYPE_HARDWARE;
+			attr.config = counter_events[i];
+			attr.read_format = PERF_FORMAT_GROUP;
+			// unprivileged users may only count user space (`perf_event_paranoid` 2, the usual default)
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+			// this thread, on any cpu
+			fds[i] = syscall(SYS_perf_event_open, &attr, 0, -1, i ? fds[0] : -1, 0);
+			if (fds[i] < 0)
+			{
+				if (hardware.exchange(false))
+					std::cerr << "StageCounters: perf_event_open: " << strerror(errno) << "; reporting time only\n";
+				open = false;
+				return;
+			}
+		}
+	}
+
+	~CounterGroup()
+	{
+		for (const auto fd : fds)
+			if (fd >= 0)
+				close(fd);
+	}
+
+	void read(uint64_t *const counters) const
+	{
+		struct
+		{
+			uint64_t nr, values[std::size(counter_events)];
+		} group;
+		if (::read(fds[0], &group, sizeof(group)) == sizeof(group))
+			std::copy_n(group.values, group.nr, counters);
+	}
+};
+
+StageCounters::Sample StageCounters::Sample::now()
+{
+	static thread_local const CounterGroup group;
+	Sample s{};
+	if (group.open)
+		group.read(s.counters);
+	s.ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	return s;
+}
+
+void StageCounters::Scope::end()
+{
+	if (ended)
+		return;
+	ended = true;
+	const auto stop = Sample::now();
+	auto &t = totals[(int)stage];
+	t.calls.fetch_add(1, std::memory_order_relaxed);
+	t.ns.fetch_add(stop.ns - start.ns, std::memory_order_relaxed);
+	for (int i = 0; i < num_counters; ++i)
+		t.counters[i].fetch_add(stop.counters[i] - start.counters[i], std::memory_order_relaxed);
+}
+
+void StageCounters::end_frame()
+{
+	frames.fetch_add(1, std::memory_order_relaxed);
+}
+
+void StageCounters::report(std::ostream &out)
+{
+	const auto n = std::max<uint64_t>(frames.exchange(0), 1);
+	const auto flags = out.flags();
+	out << "stage counters, per frame over " << n << " frame(s)" << (hardware ? "" : " (time only: hardware counters unavailable)") << ":\n"
+		<< std::setw(14) << "stage" << std::setw(8) << "calls" << std::setw(10) << "us";
+	if (hardware)
+		out << std::setw(14) << "cycles" << std::setw(14) << "instructions" << std::setw(7) << "IPC"
+			<< std::setw(14) << "cache-misses" << std::setw(14) << "branch-misses";
+	out << '\n'
+		<< std::fixed;
+
+	for (int s = 0; s < (int)Stage::COUNT; ++s)
+	{
+		auto &t = totals[s];
+		const auto calls = t.calls.exchange(0);
+		const auto ns = t.ns.exchange(0);
+		uint64_t counters[num_counters];
+		for (int i = 0; i < num_counters; ++i)
+			counters[i] = t.counters[i].exchange(0);
+		if (!calls)
+			continue;
+
+		out << std::setw(14) << stage_names[s]
+			<< std::setw(8) << std::setprecision(1) << (double)calls / n
+			<< std::setw(10) << std::setprecision(1) << ns / 1e3 / n;
+		if (hardware)
+			out << std::setw(14) << counters[0] / n
+				<< std::setw(14) << counters[1] / n
+				<< std::setw(7) << std::setprecision(2) << (counters[0] ? (double)counters[1] / counters[0] : 0)
+				<< std::setw(14) << counters[2] / n
+				<< std::setw(14) << counters[3] / n;
+		out << '\n';
+	}
+	out.flags(flags);
+}
+
+#endif
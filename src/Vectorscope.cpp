@@ -0,0 +1,75 @@
+#include "Vectorscope.hpp"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+// validates `size` before it sizes the buffer
+static int scope_size(const int size)
+{
+	if (size <= 0)
+		throw std::invalid_argument("Vectorscope: size must be positive");
+	return size;
+}
+
+Vectorscope::Vectorscope(const int size)
+	: size(scope_size(size)),
+	  intensity((size_t)size * size) {}
+
+void Vectorscope::set_persistence(const float persistence)
+{
+	if (persistence < 0 || persistence >= 1)
+		throw std::invalid_argument("Vectorscope::set_persistence: persistence must be in [0, 1)");
+	this->persistence = std::lround(persistence * 256);
+}
+
+void Vectorscope::plot(const float *const audio, const int frames, const int channels)
+{
+	const auto n = intensity.size();
+	const auto buffer = intensity.data();
+	for (size_t i = 0; i < n; ++i)
+		buffer[i] = buffer[i] * persistence >> 8;
+
+	// points are only allocated for when the number of frames grows
+	points.resize(frames);
+	const auto size = this->size;
+	const float half = (size - 1) / 2.f;
+	const auto index = [=](const float l, const float r)
+	{
+		// side and mid, halved so that full-scale audio spans the square. clamped as integers: float comparisons
+		// may trap, so the compiler won't make them branchless, which keeps the loop from vectorizing
+		const auto x = std::clamp((int)(half + (l - r) / 2 * half + .5f), 0, size - 1),
+				   y = std::clamp((int)(half - (l + r) / 2 * half + .5f), 0, size - 1);
+		return y * size + x;
+	};
+	const auto out = points.data();
+	// stereo, by far the most common, with a constant stride
+	if (channels == 2)
+		for (int i = 0; i < frames; ++i)
+			out[i] = index(audio[2 * i], audio[2 * i + 1]);
+	else
+		for (int i = 0; i < frames; ++i)
+			out[i] = index(audio[i * channels], audio[i * channels + (channels > 1)]);
+
+	for (int i = 0; i < frames; ++i)
+	{
+		auto &value = buffer[points[i]];
+		value = std::min(255, value + hit);
+	}
+}
+
+void Vectorscope::render(uint32_t *const pixels, const int pitch, const uint8_t r, const uint8_t g, const uint8_t b) const
+{
+	// a local copy: a member could alias the pixels being written, which would keep the loop from vectorizing
+	const auto size = this->size;
+	for (int y = 0; y < size; ++y)
+	{
+		const auto row = pixels + (size_t)y * pitch;
+		const auto values = intensity.data() + (size_t)y * size;
+		for (int x = 0; x < size; ++x)
+		{
+			// `c * v / 255`, rounded, without a division
+			const uint32_t v = values[x] * 257;
+			row[x] = 0xff000000 | (r * v + 32896) >> 16 << 16 | (g * v + 32896) >> 16 << 8 | (b * v + 32896) >> 16;
+		}
+	}
+}
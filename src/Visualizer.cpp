@@ -1,26 +1,110 @@
 #include "Visualizer.hpp"
 #include "ColorUtils.hpp"
+#include "AllocGuard.hpp"
+#include "StageCounters.hpp"
+#include "LibavEncoder.hpp"
+#include "YuvConverter.hpp"
+#include "WorkerPool.hpp"
 #include <SDL2pp/SDLTTF.hh>
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <exception>
+#include <utility>
+#include <sys/wait.h>
 
-Visualizer::Visualizer(const std::string &audio_file, const int width, const int height)
+static SDL2pp::Optional<SDL2pp::Window> make_window(const bool headless, const int width, const int height)
+{
+	if (headless)
+		return SDL2pp::NullOpt;
+	return SDL2pp::Window("audioviz", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, width, height, SDL_WINDOW_RESIZABLE);
+}
+
+static SDL2pp::Optional<SDL2pp::Surface> make_surface(const bool headless, const int width, const int height)
+{
+	if (!headless)
+		return SDL2pp::NullOpt;
+	// ARGB8888
+	return SDL2pp::Surface(0, width, height, 32, 0x00ff0000, 0x0000ff00, 0x000000ff, 0xff000000);
+}
+
+Visualizer::Visualizer(const std::string &audio_file, const int width, const int height, const bool headless, std::shared_ptr<AssetCache> assets)
 	: audio_file(audio_file),
-	  window("audioviz", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, width, height, SDL_WINDOW_RESIZABLE),
-	  font_large("/usr/share/fonts/TTF/Iosevka-Regular.ttc", 24),
-	  font_small("/usr/share/fonts/TTF/Iosevka-Regular.ttc", 18)
+	  window(make_window(headless, width, height)),
+	  surface(make_surface(headless, width, height)),
+	  sr(sample_size, window ? SDL_CreateRenderer(window->Get(), -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC)
+							 : SDL_CreateSoftwareRenderer(surface->Get())),
+	  assets(std::move(assets))
 {
-	font_large.SetStyle(TTF_STYLE_ITALIC);
 	const SDL2pp::Color text_color{255, 255, 255, 180};
 	if (const auto title = sf.getString(SF_STR_TITLE))
-		texture_opts.title_text.emplace(sr, font_large.RenderUTF8_Blended(title, text_color));
+		texture_opts.title_text.emplace(this->assets->text(sr, font_path, 24, TTF_STYLE_ITALIC, title, text_color));
 	if (const auto artist = sf.getString(SF_STR_ARTIST))
-		texture_opts.artist_text.emplace(sr, font_small.RenderUTF8_Blended(artist, text_color));
+		texture_opts.artist_text.emplace(this->assets->text(sr, font_path, 18, TTF_STYLE_NORMAL, artist, text_color));
+	update_analysis_channels();
+}
+
+void Visualizer::build_analyses(const std::stop_token stop)
+{
+	std::unique_lock lock(analysis_mutex);
+	while (analysis_cv.wait(lock, stop, [&]
+							{ return analysis_requested; }))
+	{
+		const auto opts = *committed_analysis;
+		analysis_requested = false;
+		analysis_building = true;
+		lock.unlock();
+
+		// free what the render thread is done with, then do the slow part without holding the lock
+		analysis_handoff.collect();
+		auto analysis = std::make_unique<Analysis>();
+		analysis->config = std::make_unique<FS::Config>(opts);
+		analysis->audio_buffer.resize(opts.fft_size * sf.channels());
+		analysis_handoff.publish(std::move(analysis));
+
+		lock.lock();
+		analysis_building = false;
+		analysis_cv.notify_all();
+	}
+}
+
+void Visualizer::commit_analysis()
+{
+	const std::lock_guard lock(analysis_mutex);
+	if (committed_analysis == requested_analysis)
+		return;
+	committed_analysis = requested_analysis;
+	analysis_requested = true;
+	analysis_cv.notify_all();
+}
+
+bool Visualizer::adopt_analysis()
+{
+	auto analysis = analysis_handoff.take();
+	if (!analysis)
+		return false;
+	analysis->config = sr.swap_analysis_config(std::move(analysis->config));
+	audio_buffer.swap(analysis->audio_buffer);
+	sample_size = sr.analysis_options().fft_size;
+	analysis_handoff.retire(std::move(analysis));
+	return true;
+}
+
+void Visualizer::wait_for_analysis()
+{
+	{
+		std::unique_lock lock(analysis_mutex);
+		analysis_cv.wait(lock, [&]
+						 { return !analysis_requested && !analysis_building; });
+	}
+	adopt_analysis();
 }
 
 // assumes `texture_opts.bg` has a value
 SDL2pp::Rect Visualizer::bg_texture_centered_max_width()
 {
 	const auto &texture = texture_opts.bg.value();
-	const float aspect_ratio = (float)window.GetWidth() / window.GetHeight();
+	const float aspect_ratio = (float)sr.GetOutputWidth() / sr.GetOutputHeight();
 
 	// Calculate the height of the rectangle based on the renderer's aspect ratio
 	int rectHeight = static_cast<int>(texture.GetWidth() / aspect_ratio);
@@ -41,133 +125,555 @@ SDL2pp::Rect Visualizer::bg_texture_centered_max_width()
 	return SDL2pp::Rect(rectX, rectY, rectWidth, rectHeight);
 }
 
-void Visualizer::do_actual_rendering()
+std::array<SDL2pp::Rect, Visualizer::FS::max_channels> Visualizer::spectrum_rects(const int count)
 {
-	const auto width = window.GetWidth(),
-			   height = window.GetHeight();
+	const auto width = sr.GetOutputWidth(),
+			   height = sr.GetOutputHeight() - waveform_band_height();
 
 	// still need to parameterize this
 	static const auto margin = 5;
 
-	// bg
-	if (texture_opts.bg.has_value())
-		sr.Copy(texture_opts.bg.value(), bg_texture_centered_max_width());
-	else
-		sr.SetDrawColor().Clear();
+	if (count <= 0)
+		return {};
+
+	// default for mono
+	if (count == 1)
+		return {SDL2pp::Rect(margin, margin, width - 2 * margin, height - 2 * margin)};
 
 	// default for stereo
-	if (sf.channels() == 2 && mono < 0)
+	if (count == 2 && layout == Layout::GRID)
 	{
 		const auto w = (width - 2 * margin - sr.bar.get_spacing()) / 2;
 		const auto h = height - 2 * margin;
-		const SDL2pp::Rect
-			rect1(margin, margin, w, h),
-			rect2(rect1.x + rect1.w + sr.bar.get_spacing() - 1, margin, w, h);
-		// uncomment to debug spectrum boundaries (which SpectrumRenderer should respect)
-		// sr.SetDrawColor(255, 255, 255).DrawRect(rect1).DrawRect(rect2);
-		sr.copy_channel_to_input(audio_buffer.data(), sf.channels(), 0, true);
-		sr.render_spectrum(rect1, true);
-		sr.copy_channel_to_input(audio_buffer.data(), sf.channels(), 1, true);
-		sr.render_spectrum(rect2, false);
+		const SDL2pp::Rect rect1(margin, margin, w, h);
+		return {rect1, SDL2pp::Rect(rect1.x + rect1.w + sr.bar.get_spacing() - 1, margin, w, h)};
 	}
-	// default for mono
+
+	// surround: a grid of equal cells in channel order, row by row
+	const auto cols = layout == Layout::STACKED ? 1 : (int)std::ceil(std::sqrt(count));
+	const auto rows = (count + cols - 1) / cols;
+	const auto w = (width - 2 * margin - (cols - 1) * sr.bar.get_spacing()) / cols;
+	const auto h = (height - (rows + 1) * margin) / rows;
+	std::array<SDL2pp::Rect, FS::max_channels> rects;
+	for (int i = 0; i < count; ++i)
+		rects[i] = SDL2pp::Rect(margin + i % cols * (w + sr.bar.get_spacing()), margin + i / cols * (h + margin), w, h);
+	return rects;
+}
+
+int Visualizer::max_spectrum_bars(const int width, const int height) const
+{
+	return std::max(sr.bar_count({0, 0, width, height}), sr.radial_bar_count(std::min(width, height) / 4, 2 * M_PI));
+}
+
+Visualizer::RadialGeometry Visualizer::radial_geometry()
+{
+	const auto width = sr.GetOutputWidth(),
+			   height = sr.GetOutputHeight() - waveform_band_height();
+	// the circle takes half the shorter side, and full-scale bars most of the rest
+	const auto size = std::min(width, height);
+	return {{width / 2, height / 2}, size / 4, std::max(1, size / 4 - 5)};
+}
+
+std::pair<float, float> Visualizer::radial_arc(const int index, const int count) const
+{
+	// from the top; stereo's left channel goes counterclockwise, mirroring the right
+	if (count == 2)
+		return {-M_PI / 2, index ? M_PI : -M_PI};
+	return {-M_PI / 2 + 2 * M_PI * index / count, 2 * M_PI / count};
+}
+
+void Visualizer::transform_audio()
+{
+	if (analysis_channels() == 1)
+		sr.copy_channel_to_input(audio_buffer.data(), sf.channels(), std::max(mono, 0), true);
 	else
+		// all channels in one batched transform, however many spectra are derived from them
+		sr.copy_channels_to_input(audio_buffer.data(), sf.channels());
+	sr.transform();
+}
+
+void Visualizer::bin(const Visualizer &source, SpectrumFrame &frame, const int bars, const int hop)
+{
+	// only allocates when the window grows
+	if (vectorscope)
+		frame.audio.assign(source.audio_buffer.begin(), source.audio_buffer.end());
+
+	frame.count = spectrum_count();
+	// read here, on the analyzing thread, as a new analysis may change it before the frame is drawn
+	frame.samples = source.sample_size;
+	// only allocates when the number of bars grows
+	for (int i = 0; i < frame.count; ++i)
+		frame.spectra[i].resize(bars);
+
+	if (engine == AnalysisEngine::BIQUAD)
 	{
-		SDL2pp::Rect rect(margin, margin, width - 2 * margin, height - 2 * margin);
-		sr.copy_channel_to_input(audio_buffer.data(), sf.channels(), mono, false);
-		sr.render_spectrum(rect, false);
+		// the scale may have been changed since the filters were designed, e.g. by a live key
+		const auto &opts = sr.analysis_options();
+		for (int i = 0; i < frame.count; ++i)
+		{
+			biquads[i].set_scale(opts.scale);
+			biquads[i].set_nth_root(opts.nth_root);
+			biquads[i].process(source.audio_buffer.data(), std::min(hop, source.sample_size), source.sf.channels(), frame.count > 1 ? i : std::max(mono, 0));
+			biquads[i].render(frame.spectra[i]);
+		}
+		return;
 	}
 
-	// metadata
+	for (int i = 0; i < frame.count; ++i)
+	{
+		if (views.empty())
+		{
+			sr.analyze(source.sr.bins(i), frame.spectra[i]);
+			continue;
+		}
+		FS::mix(source.sr.bins(0), views[i].left, source.sr.bins(1), views[i].right, view_bins);
+		sr.analyze(view_bins, frame.spectra[i]);
+	}
+}
+
+void Visualizer::analyze(SpectrumFrame &frame, const int bars, const int hop)
+{
+	if (engine == AnalysisEngine::FFT)
+		transform_audio();
+	bin(*this, frame, bars, hop);
+}
+
+void Visualizer::reset_biquads()
+{
+	biquads.clear();
+	if (engine != AnalysisEngine::BIQUAD)
+		return;
+	const auto &opts = sr.analysis_options();
+	for (int i = 0; i < spectrum_count(); ++i)
+	{
+		auto &bq = biquads.emplace_back(sf.samplerate());
+		bq.set_scale(opts.scale);
+		bq.set_nth_root(opts.nth_root);
+		bq.reset(spectrum_bars());
+	}
+}
+
+void Visualizer::blend(const SpectrumFrame &a, const SpectrumFrame &b, const float t, SpectrumFrame &out)
+{
+	// spectra analyzed before a channel mode or window size change can't be blended with newer ones
+	if (a.count != b.count || a.spectra[0].size() != b.spectra[0].size())
+	{
+		out = b;
+		return;
+	}
+
+	out.count = b.count;
+	out.position = a.position + t * (b.position - a.position);
+	out.samples = t < .5f ? a.samples : b.samples;
+	out.audio = t < .5f ? a.audio : b.audio;
+	for (int i = 0; i < b.count; ++i)
+	{
+		const auto n = b.spectra[i].size();
+		out.spectra[i].resize(n);
+		// simple enough for the compiler to vectorize
+		const auto pa = a.spectra[i].data(), pb = b.spectra[i].data();
+		const auto po = out.spectra[i].data();
+		for (size_t j = 0; j < n; ++j)
+			po[j] = pa[j] + t * (pb[j] - pa[j]);
+	}
+}
+
+void Visualizer::draw(const SpectrumFrame &frame)
+{
+	const StageCounters::Scope scope(StageCounters::Stage::DRAW);
+
+	draw_background();
+
+	// spectra; in a stereo grid the left channel grows from the center outwards
+	if (layout == Layout::RADIAL)
+	{
+		const auto radial = radial_geometry();
+		for (int i = 0; i < frame.count; ++i)
+		{
+			const auto [start, sweep] = radial_arc(i, frame.count);
+			sr.draw_radial_spectrum(frame.spectra[i], radial.center, radial.radius, radial.length, start, sweep, i);
+		}
+	}
+	else
+	{
+		const auto rects = spectrum_rects(frame.count);
+		// uncomment to debug spectrum boundaries (which SpectrumRenderer should respect)
+		// sr.SetDrawColor(255, 255, 255).DrawRect(rects[0]).DrawRect(rects[1]);
+		for (int i = 0; i < frame.count; ++i)
+		{
+			const auto backwards = frame.count == 2 && layout == Layout::GRID && !i;
+			if (spectrogram)
+				sr.draw_spectrogram(frame.spectra[i], rects[i], backwards, i);
+			sr.draw_spectrum(frame.spectra[i], rects[i], backwards);
+		}
+	}
+
+	draw_waveforms(frame.position + frame.samples / 2);
+	draw_metadata();
+	// last, as the cpu rasterizer can only draw it onto the finished frame
+	draw_vectorscope(frame);
+}
+
+void Visualizer::draw(const SpectrumFrame &frame, FrameRasterizer &target, uint32_t *const pixels)
+{
+	const StageCounters::Scope scope(StageCounters::Stage::DRAW);
+	const auto rects = spectrum_rects(frame.count);
+	for (int i = 0; i < frame.count; ++i)
+		sr.draw_spectrum(frame.spectra[i], rects[i], frame.count == 2 && layout == Layout::GRID && !i, target);
+	draw_waveforms(frame.position + frame.samples / 2, &target);
+	target.render(pixels);
+	draw_vectorscope(frame, pixels);
+}
+
+void Visualizer::draw_background()
+{
+	if (texture_opts.bg.has_value())
+		sr.Copy(texture_opts.bg.value(), bg_texture_centered_max_width());
+	else
+		sr.SetDrawColor().Clear();
+}
+
+void Visualizer::draw_metadata()
+{
 	const SDL2pp::Point metadata_start{40, 40};
 
-	const SDL2pp::Rect album_art_rect{metadata_start.x, metadata_start.y, 140, 140};
+	// the radial layout puts the album art inside its circle, leaving the corner to the text
+	const auto radial = layout == Layout::RADIAL;
+	auto album_art_rect = SDL2pp::Rect{metadata_start.x, metadata_start.y, 140, 140};
+	if (radial)
+	{
+		const auto [center, radius, length] = radial_geometry();
+		const auto side = (int)(radius * M_SQRT2);
+		album_art_rect = {center.x - side / 2, center.y - side / 2, side, side};
+	}
 	const auto album_art_texture_present = texture_opts.album_art.has_value();
 	if (album_art_texture_present)
 		sr.Copy(texture_opts.album_art.value(), SDL2pp::NullOpt, album_art_rect);
 	
-	const SDL2pp::Point title_pt{metadata_start.x + album_art_texture_present * (album_art_rect.w + 10), album_art_rect.y};
+	const SDL2pp::Point title_pt{metadata_start.x + (album_art_texture_present && !radial) * (album_art_rect.w + 10), metadata_start.y};
 	if (texture_opts.title_text.has_value())
 		sr.Copy(texture_opts.title_text.value(), SDL2pp::NullOpt, title_pt);
 	if (texture_opts.artist_text.has_value())
 		sr.Copy(texture_opts.artist_text.value(), SDL2pp::NullOpt, {title_pt.x, title_pt.y + 30});
 }
 
-void Visualizer::start()
+int Visualizer::waveform_band_height() const
+{
+	return waveform_spans.size() * (waveform_height + 5);
+}
+
+void Visualizer::extend_peaks(const long samples)
+{
+	const auto chunk = (int)(waveform_audio.size() / sf.channels());
+	while (peaks.size() < samples)
+	{
+		const auto read = waveform_sf.readf(waveform_audio.data(), chunk);
+		if (read <= 0)
+			return;
+		peaks.append(waveform_audio.data(), read, sf.channels());
+	}
+}
+
+void Visualizer::draw_waveforms(const long center, FrameRasterizer *const target)
+{
+	const auto width = sr.GetOutputWidth() - 10,
+			   top = sr.GetOutputHeight() - waveform_band_height();
+	if (waveform_spans.empty() || width <= 0)
+		return;
+
+	// only allocates when the output grows
+	waveform_peaks.resize(width);
+	waveform_points.resize(2 * width);
+	const auto [r, g, b] = sr.color.get(0);
+
+	for (int i = 0; i < (int)waveform_spans.size(); ++i)
+	{
+		const auto samples_per_pixel = (double)waveform_spans[i] * sf.samplerate() / width;
+		const auto first = center - samples_per_pixel * width / 2;
+		extend_peaks((long)(first + samples_per_pixel * width) + 1);
+		peaks.query(first, samples_per_pixel, waveform_peaks);
+
+		// one column per pixel from the lowest to the highest sample under it
+		const auto mid = top + i * (waveform_height + 5) + waveform_height / 2;
+		const auto amplitude = waveform_height / 2;
+		const auto y = [&](const float sample)
+		{
+			return mid - (int)std::lround(std::clamp(sample, -1.f, 1.f) * amplitude);
+		};
+
+		if (target)
+		{
+			for (int x = 0; x < width; ++x)
+				target->box(5 + x, y(waveform_peaks[x].max), 5 + x, y(waveform_peaks[x].min), r, g, b);
+			continue;
+		}
+
+		// all columns as one polyline, alternating direction so that neighbors join at the same end
+		for (int x = 0; x < width; ++x)
+		{
+			const auto a = y(waveform_peaks[x].max), z = y(waveform_peaks[x].min);
+			waveform_points[2 * x] = {5 + x, x % 2 ? z : a};
+			waveform_points[2 * x + 1] = {5 + x, x % 2 ? a : z};
+		}
+		sr.SetDrawColor(r, g, b).DrawLines(waveform_points.data(), waveform_points.size());
+	}
+}
+
+void Visualizer::draw_vectorscope(const SpectrumFrame &frame, uint32_t *const pixels)
+{
+	if (!vectorscope)
+		return;
+	const auto size = vectorscope->get_size();
+	const SDL2pp::Rect rect(sr.GetOutputWidth() - size - 5, 5, size, size);
+	if (rect.x < 0 || rect.y + size > sr.GetOutputHeight())
+		return;
+
+	vectorscope->plot(frame.audio.data(), frame.audio.size() / sf.channels(), sf.channels());
+	const auto [r, g, b] = sr.color.get(0);
+	if (pixels)
+	{
+		// over everything else, straight into the frame
+		vectorscope->render(pixels + rect.y * sr.GetOutputWidth() + rect.x, sr.GetOutputWidth(), r, g, b);
+		return;
+	}
+	vectorscope->render(vectorscope_pixels.data(), size, r, g, b);
+	vectorscope_texture->Update(SDL2pp::NullOpt, vectorscope_pixels.data(), size * sizeof(uint32_t));
+	sr.Copy(*vectorscope_texture, SDL2pp::NullOpt, rect);
+}
+
+void Visualizer::render_static_layers(FrameRasterizer &target)
+{
+	const auto width = sr.GetOutputWidth(),
+			   height = sr.GetOutputHeight();
+
+	// drawn into a texture rather than the output, which may have no alpha channel
+	SDL2pp::Texture layer(sr, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET, width, height);
+	std::vector<uint32_t> pixels(width * height);
+	sr.SetTarget(layer);
+
+	draw_background();
+	sr.ReadPixels(SDL2pp::NullOpt, SDL_PIXELFORMAT_ARGB8888, pixels.data(), 4 * width);
+	target.set_background(pixels);
+
+	// blending the metadata onto transparent black premultiplies it by its alpha, as the overlay expects
+	sr.SetDrawColor(0, 0, 0, 0).Clear();
+	draw_metadata();
+	sr.ReadPixels(SDL2pp::NullOpt, SDL_PIXELFORMAT_ARGB8888, pixels.data(), 4 * width);
+	target.set_overlay(std::move(pixels));
+
+	sr.SetTarget();
+}
+
+int Visualizer::spectrum_count() const
+{
+	if (!views.empty() && engine == AnalysisEngine::FFT)
+		return views.size();
+	// audio with more channels than can be analyzed together falls back to mono, on the first channel
+	return (mono >= 0 || sf.channels() > FS::max_channels) ? 1 : sf.channels();
+}
+
+int Visualizer::analysis_channels() const
+{
+	// views are mixed from both channels of the stereo pair
+	return views.empty() ? spectrum_count() : 2;
+}
+
+void Visualizer::update_analysis_channels()
+{
+	const auto channels = analysis_channels();
+	reconfigure_analysis([&](FS::Options &opts)
+						 { opts.channels = channels; });
+}
+
+int Visualizer::spectrum_bars()
+{
+	if (layout == Layout::RADIAL)
+		return sr.radial_bar_count(radial_geometry().radius, radial_arc(0, spectrum_count()).second);
+	return sr.bar_count(spectrum_rects(spectrum_count())[0]);
+}
+
+void Visualizer::play_and_analyze(const std::stop_token stop, const int hop, const int total_frames, LiveState &state)
 {
 	// start portaudio stream for live audio playback
 	PortAudio pa;
 	auto pa_stream = pa.stream(0, sf.channels(), paFloat32, sf.samplerate(), sample_size);
 
+	// the frames of `state.spectra` are sized up front by `start`. a new analysis, or more bars than ever before,
+	// may resize each of the three over the next three frames, so those warm up again
+	AllocGuard alloc_guard(3);
+	int most_bars = 0;
+
+	for (int frame = 0; frame < total_frames && !stop.stop_requested(); ++frame)
+	{
+		alloc_guard.begin_frame();
+		const auto bars = state.bars.load(std::memory_order_relaxed);
+		if (adopt_analysis() || bars > most_bars)
+			alloc_guard.restart();
+		most_bars = std::max(most_bars, bars);
+
+		// read in audio from file, write to portaudio stream
+		const auto frames_read = sf.readf(audio_buffer.data(), sample_size);
+
+		if (!frames_read)
+			break;
+
+		// the write blocks until the stream has room, which paces this thread at the audio hop rate.
+		// if this thread falls behind, "Output underflowed" is thrown; we just keep going
+		try
+		{
+			pa_stream.write(audio_buffer.data(), hop);
+		}
+		catch (const PortAudio::Error &e)
+		{
+			if (e.err != paOutputUnderflowed)
+				throw;
+		}
+
+		if (frames_read != sample_size)
+			break;
+
+		analyze(state.spectra.back(), bars, hop);
+		state.spectra.back().position = (long)frame * hop;
+		state.spectra.publish();
+		state.frame.store(frame + 1, std::memory_order_relaxed);
+
+		// seek audio file back
+		sf.seek(hop - sample_size, SEEK_CUR);
+		alloc_guard.end_frame();
+	}
+}
+
+void Visualizer::start()
+{
+	if (!window)
+		throw std::logic_error("Visualizer::start: headless visualizers can only encode");
+
+	commit_analysis();
+	wait_for_analysis();
+	reset_biquads();
+
 	// calculate the number of audio frames that fit in each video frame
 	SDL_DisplayMode mode;
-	window.GetDisplayMode(mode);
+	window->GetDisplayMode(mode);
 	const auto avpvf = sf.samplerate() / mode.refresh_rate;
-	const int total_frames = sf.frames() / avpvf;
+	// with an analysis rate, spectra are analyzed every `hop` samples and blended per video frame
+	const auto hop = analysis_rate ? sf.samplerate() / analysis_rate : avpvf;
+	const int total_frames = sf.frames() / hop;
+
+	// audio playback and analysis run on their own thread, so FFT spikes never delay drawing;
+	// this thread draws the freshest complete spectrum at the display's refresh rate
+	LiveState state;
+	state.bars = spectrum_bars();
+
+	// when blending: the two most recent spectra
+	SpectrumFrame previous, latest, blended;
+
+	// every frame either thread fills, sized for the window maximized on this display, so that neither allocates
+	const auto bars = max_spectrum_bars(std::max(mode.w, sr.GetOutputWidth()), std::max(mode.h, sr.GetOutputHeight()));
+	const size_t samples = vectorscope ? audio_buffer.size() : 0;
+	state.spectra.for_each([&](SpectrumFrame &frame)
+						   { frame.reserve(bars, samples); });
+	for (auto frame : {&previous, &latest, &blended})
+		frame->reserve(bars, samples);
+
+	std::exception_ptr analysis_error;
+	std::jthread analysis_thread([&](const std::stop_token stop)
+	{
+		try
+		{
+			play_and_analyze(stop, hop, total_frames, state);
+		}
+		catch (...)
+		{
+			analysis_error = std::current_exception();
+		}
+		state.done = true;
+	});
 
 	// for measuring render time
 	using namespace std::chrono;
 	using hrc = high_resolution_clock;
 	hrc::time_point draw_start, fps_start;
-	milliseconds draw_time;
-	double fps;
+	// printed once more after the loop, which may not have drawn a single frame
+	milliseconds draw_time{};
+	double fps = 0;
 
-	// frame counter
-	int frame = 0;
+	// number of frames drawn
+	int drawn = 0;
 
 	// lambda function to print render stats
 	const auto print_render_stats = [&]
 	{
-		if (frame % 10)
+		if (drawn % 10)
 			return;
+		const int frame = state.frame;
 		std::cout << "\r\e[2K\e[1A\e[2K\e[1A\e[2K"
 				  << "Frame/Total: " << frame << '/' << total_frames << " (" << (((double)frame / total_frames) * 100) << "%)\n"
-				  << "Draw time: " << draw_time << '\n'
+				  << "Draw time: " << draw_time.count() << "ms\n"
 				  << "FPS: " << fps
 				  << std::flush;
 	};
 
-	for (; frame < total_frames; ++frame)
-	{
-		handle_events();
+	// when the latest spectra arrived
+	hrc::time_point latest_start;
 
-		// read in audio from file, write to portaudio stream
-		const auto frames_read = sf.readf(audio_buffer.data(), sample_size);
+	// whether any spectra were published yet, and what is drawn before: the background and metadata alone
+	bool published = false;
+	const SpectrumFrame nothing;
+	const duration<double> hop_duration(hop / (double)sf.samplerate());
 
-		if (!frames_read)
-			break;
+	AllocGuard alloc_guard;
 
-		// occasionally, rendering might take too long until this is called again, causing "Output underflowed" to be thrown
-		// the only way to get around this is dynamically changing the stream's samplerate to match our render time, but that sounds horrible...
-		try
-		{
-			pa_stream.write(audio_buffer.data(), avpvf);
-		}
-		catch (const PortAudio::Error &e)
-		{
-			if (e.err != paOutputUnderflowed)
-				throw;
-		}
+	for (; !state.done; ++drawn)
+	{
+		alloc_guard.begin_frame();
+		handle_events(hop);
 
-		if (frames_read != sample_size)
-			break;
+		// the window may have been resized
+		state.bars.store(spectrum_bars(), std::memory_order_relaxed);
 
 		// perform rendering while measuring time
 		draw_start = fps_start = hrc::now();
-		do_actual_rendering();
+		const auto fresh = state.spectra.update();
+		published |= fresh;
+		if (!published)
+			// until the analysis thread publishes its first spectra, the front buffer holds none
+			draw(nothing);
+		else if (!analysis_rate)
+			draw(state.spectra.front());
+		else
+		{
+			if (fresh)
+			{
+				// copy-assigning only allocates when a reconfiguration grew the frames past their reserve
+				if (!previous.fits(state.spectra.front()))
+					alloc_guard.restart();
+				std::swap(previous, latest);
+				latest = state.spectra.front();
+				latest_start = draw_start;
+			}
+			// sweep from the previous spectra to the latest over one hop, one hop behind the audio
+			const float t = std::min(1., duration<double>(draw_start - latest_start) / hop_duration);
+			blend(previous, latest, t, blended);
+			draw(blended);
+		}
 		draw_time = duration_cast<milliseconds>(hrc::now() - draw_start);
 		sr.Present();
 		fps = 1 / duration<double>(hrc::now() - fps_start).count();
 		print_render_stats();
+		StageCounters::end_frame();
 
-		// seek audio file back
-		sf.seek(avpvf - sample_size, SEEK_CUR);
+		alloc_guard.end_frame();
 	}
 
+	analysis_thread.join();
 	print_render_stats();
+
+	if (analysis_error)
+		std::rethrow_exception(analysis_error);
 }
 
-void Visualizer::handle_events()
+void Visualizer::handle_events(const int hop)
 {
 	SDL_Event event;
 	while (SDL_PollEvent(&event))
@@ -175,57 +681,472 @@ void Visualizer::handle_events()
 		{
 		case SDL_QUIT:
 			exit(0);
+		case SDL_KEYDOWN:
+			handle_key(event.key.keysym.sym, hop);
 		}
 }
 
-void Visualizer::encode_to_video(const std::string &output_file, const int fps, const std::string &vcodec, const std::string &acodec)
+void Visualizer::handle_key(const SDL_Keycode key, const int hop)
 {
-	const auto width = window.GetWidth(),
-			   height = window.GetHeight();
+	const auto opts = [&]
+	{
+		const std::lock_guard lock(analysis_mutex);
+		return requested_analysis;
+	}();
 
-	std::ostringstream ss;
-	ss << '\'' << ffmpeg_path
-	   << "' -hide_banner -y -f rawvideo -pix_fmt rgb24 -s:v "
-	   << width << 'x' << height
-	   << " -r " << fps
-	   // this right here has solved the a/v desync!
-	   // i'm sure this delay isn't going to be the right number for every machine
-	   // but we're gonna roll with it
-	   << " -i - -ss -0.1 -i '" << audio_file
-	   << "' -c:v " << vcodec
-	   << " -c:a " << acodec
-	   << " -shortest '"
-	   << output_file
-	   << '\'';
+	try
+	{
+		switch (key)
+		{
+		case SDLK_UP:
+			set_sample_size(opts.fft_size * 2);
+			break;
+		case SDLK_DOWN:
+			// every hop is played out of the audio buffer
+			if (opts.fft_size / 2 < hop)
+				throw std::invalid_argument("Visualizer::handle_key: sample size can't be smaller than the hop of " + std::to_string(hop));
+			set_sample_size(opts.fft_size / 2);
+			break;
+		case SDLK_s:
+			set_scale((FS::Scale)(((int)opts.scale + 1) % 3));
+			break;
+		case SDLK_w:
+			set_window_function((FS::WindowFunction)(((int)opts.wf + 1) % 4));
+			break;
+		case SDLK_a:
+			set_accum_method((FS::AccumulationMethod)(((int)opts.am + 1) % 3));
+			break;
+		default:
+			return;
+		}
+	}
+	catch (const std::invalid_argument &e)
+	{
+		// a key press that would make the options invalid is ignored
+		std::cerr << "\n" << e.what() << '\n';
+		return;
+	}
+	commit_analysis();
+}
 
-	const auto command = ss.str();
-	std::cout << command << '\n';
-	const auto ffmpeg = popen(command.c_str(), "w");
+// the encoding half of `encode_to_video`: draws frames through either rasterizer and sends them to either backend
+class Visualizer::VideoEncoder
+{
+	Visualizer &viz;
+	const int width, height;
+	// the cpu rasterizer's ARGB8888 frames are sent as is: in little-endian memory, that is `bgra`
+	const bool cpu;
 
-	if (!ffmpeg)
-		throw std::runtime_error(std::string("popen: ") + strerror(errno));
+	// frames reach the encoder as drawn, or converted to yuv on our side
+	std::optional<YuvConverter> yuv;
 
-	const size_t framesize = 3 * width * height;
-	Uint8 pixels[framesize];
+	// exactly one of these receives the frames
+	FILE *ffmpeg = nullptr;
+	std::optional<LibavEncoder> libav;
 
+	// heap-allocated: a 4K frame is larger than the default stack. 4 bytes per pixel fit either format
+	size_t framesize;
+	std::vector<uint32_t> pixels;
+	std::vector<uint8_t> yuv_frame;
+
+	std::optional<FrameRasterizer> cpu_rasterizer;
+
+	// the `SDL` rasterizer draws frame `n` into `targets[n % readback_ring]`, then reads back the oldest frame still
+	// in the ring: the frame before, whose commands the renderer has long flushed, so reading it back does not wait for
+	// the frame just drawn. the software renderer takes the same path, only without anything to overlap
+	static constexpr int readback_ring = 2;
+	std::vector<SDL2pp::Texture> targets;
+	long drawn = 0;
+
+	// reads frame `n` back into `pixels`
+	void read_back(const long n)
+	{
+		const StageCounters::Scope scope(StageCounters::Stage::READBACK);
+		viz.sr.SetTarget(targets[n % readback_ring]);
+		viz.sr.ReadPixels(SDL2pp::NullOpt, SDL_PIXELFORMAT_RGB24, pixels.data(), 3 * width);
+	}
+
+	// sends the frame in `pixels` to the encoder
+	void send()
+	{
+		// converted straight into the encoder's frame, when it takes our yuv as is
+		if (yuv && libav && libav->in_place())
+		{
+			uint8_t *planes[3];
+			int strides[3];
+			libav->frame_planes(planes, strides);
+			{
+				const StageCounters::Scope scope(StageCounters::Stage::CONVERT);
+				yuv->convert(pixels.data(), planes, strides);
+			}
+			libav->write_frame();
+			return;
+		}
+
+		const void *frame = pixels.data();
+		if (yuv)
+		{
+			const StageCounters::Scope scope(StageCounters::Stage::CONVERT);
+			yuv->convert(pixels.data(), yuv_frame.data());
+			frame = yuv_frame.data();
+		}
+		if (libav)
+			libav->write(frame);
+		else if (fwrite(frame, 1, framesize, ffmpeg) < framesize)
+			throw std::runtime_error(std::string("fwrite: ") + strerror(errno));
+	}
+
+public:
+	/**
+	 * Starts the encoder. Expects `viz`'s analysis to be adopted, for the static layers of the `CPU` rasterizer.
+	 * @param audio whether to mux in `viz`'s audio file
+	 * @throws `std::runtime_error` if `ffmpeg` can't be started
+	 */
+	VideoEncoder(Visualizer &viz, const std::string &output_file, const int fps, const std::string &vcodec, const std::string &acodec, const bool audio)
+		: viz(viz),
+		  width(viz.sr.GetOutputWidth()),
+		  height(viz.sr.GetOutputHeight()),
+		  // the cpu rasterizer has no textures to draw the spectrogram with
+		  cpu(viz.rasterizer == Rasterizer::CPU && !viz.spectrogram && viz.layout != Layout::RADIAL)
+	{
+		const auto nv12 = viz.encode_pixel_format == EncodePixelFormat::NV12;
+		if (viz.encode_pixel_format != EncodePixelFormat::RGB)
+			yuv.emplace(width, height, cpu ? YuvConverter::InputFormat::BGRA : YuvConverter::InputFormat::RGB24,
+						nv12 ? YuvConverter::OutputFormat::NV12 : YuvConverter::OutputFormat::YUV420P, viz.raster_threads);
+		const auto pix_fmt = yuv ? (nv12 ? "nv12" : "yuv420p") : cpu ? "bgra" : "rgb24";
+
+		if (viz.encoder_backend == EncoderBackend::LIBAV)
+		{
+			using F = LibavEncoder::InputFormat;
+			libav.emplace(output_file, width, height, fps, yuv ? (nv12 ? F::NV12 : F::YUV420P) : cpu ? F::BGRA : F::RGB24,
+						  vcodec, acodec, audio ? viz.audio_file : "", viz.ffmpeg_loglevel);
+		}
+		else
+		{
+			std::ostringstream ss;
+			ss << '\'' << viz.ffmpeg_path << "' -hide_banner";
+			if (!viz.ffmpeg_loglevel.empty())
+				ss << " -loglevel " << viz.ffmpeg_loglevel;
+			ss << " -y -f rawvideo -pix_fmt " << pix_fmt << " -s:v "
+			   << width << 'x' << height
+			   << " -r " << fps
+			   << " -i -";
+			if (!audio)
+				ss << " -c:v " << vcodec << " -an";
+			else
+				// this right here has solved the a/v desync!
+				// i'm sure this delay isn't going to be the right number for every machine
+				// but we're gonna roll with it
+				ss << " -ss -0.1 -i '" << viz.audio_file
+				   << "' -c:v " << vcodec
+				   << " -c:a " << acodec
+				   << " -shortest";
+			ss << " '" << output_file << '\'';
+
+			const auto command = ss.str();
+			std::cout << command << '\n';
+			ffmpeg = popen(command.c_str(), "w");
+
+			if (!ffmpeg)
+				throw std::runtime_error(std::string("popen: ") + strerror(errno));
+		}
+
+		framesize = yuv ? YuvConverter::frame_size(width, height) : (cpu ? 4 : 3) * width * height;
+		pixels.resize(width * height);
+		yuv_frame.resize(yuv && !(libav && libav->in_place()) ? framesize : 0);
+
+		if (cpu)
+			viz.render_static_layers(cpu_rasterizer.emplace(width, height, viz.raster_threads));
+		else
+			for (int i = 0; i < readback_ring; ++i)
+				targets.emplace_back(viz.sr, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET, width, height);
+	}
+
+	// an encode cut short by an exception still reaps its `ffmpeg`
+	~VideoEncoder()
+	{
+		if (ffmpeg)
+			pclose(ffmpeg);
+	}
+
+	/**
+	 * Draws `spectra` into one video frame and sends it to the encoder, or with the `SDL` rasterizer, sends the
+	 * frame drawn `readback_ring - 1` calls earlier, if any.
+	 * @throws `std::runtime_error` if `ffmpeg` stopped reading
+	 */
+	void write(const SpectrumFrame &spectra)
+	{
+		if (cpu)
+		{
+			viz.draw(spectra, *cpu_rasterizer, pixels.data());
+			send();
+			return;
+		}
+
+		viz.sr.SetTarget(targets[drawn % readback_ring]);
+		viz.draw(spectra);
+		// submits the frame without waiting for it
+		SDL_RenderFlush(viz.sr.Get());
+		if (++drawn >= readback_ring)
+		{
+			read_back(drawn - readback_ring);
+			send();
+		}
+	}
+
+	/**
+	 * Sends the frames still in the readback ring, flushes the encoder and closes the output.
+	 * @throws `std::runtime_error` if `ffmpeg` failed
+	 */
+	void finish()
+	{
+		for (auto n = std::max(0l, drawn - readback_ring + 1); n < drawn; ++n)
+		{
+			read_back(n);
+			send();
+		}
+		if (!cpu)
+			viz.sr.SetTarget();
+
+		if (libav)
+		{
+			libav->finish();
+			return;
+		}
+		const auto status = pclose(std::exchange(ffmpeg, nullptr));
+		if (status == -1)
+			throw std::runtime_error(std::string("pclose: ") + strerror(errno));
+		if (status)
+			throw std::runtime_error(viz.ffmpeg_path + " exited with status " + std::to_string(WEXITSTATUS(status)));
+	}
+};
+
+int Visualizer::encode_to_video(const std::string &output_file, const int fps, const std::string &vcodec, const std::string &acodec)
+{
 	const auto afpvf = sf.samplerate() / fps;
+	// with an analysis rate, spectra are analyzed every `hop` samples and blended per video frame.
+	// the biquad engine must see every hop in order, which only a hop of one video frame guarantees
+	const auto hop = analysis_rate && engine == AnalysisEngine::FFT ? sf.samplerate() / analysis_rate : afpvf;
+	AllocGuard alloc_guard;
+
+	commit_analysis();
+	wait_for_analysis();
+	reset_biquads();
 
-	while (const auto frames_read = sf.readf(audio_buffer.data(), sample_size))
+	// segments are video only; the audio is muxed in once they are concatenated
+	const auto segmented = segment_count > 1;
+	VideoEncoder encoder(*this, output_file, fps, vcodec, acodec, !segmented);
+
+	// spectra of the hops numbered in `hops`, and the blend of the two
+	SpectrumFrame spectra[2], blended;
+	long hops[2]{-1, -1};
+
+	// returns the spectrum of the hop starting at sample `k * hop`, analyzing it if necessary
+	// without evicting hop `keep`. returns null at the end of the audio
+	const auto spectrum_at = [&](const long k, const long keep) -> const SpectrumFrame *
 	{
-		if (frames_read != sample_size)
+		for (const int i : {0, 1})
+			if (hops[i] == k)
+				return &spectra[i];
+		const int i = hops[0] == keep;
+		sf.seek(k * hop, SEEK_SET);
+		if (sf.readf(audio_buffer.data(), sample_size) != sample_size)
+			return nullptr;
+		analyze(spectra[i], spectrum_bars(), hop);
+		spectra[i].position = k * hop;
+		hops[i] = k;
+		return &spectra[i];
+	};
+
+	// returns the spectra of video frame `frame`: those of its hop, or their blend with the next one's.
+	// returns null at the end of the audio
+	const auto frame_spectra = [&](const long frame) -> const SpectrumFrame *
+	{
+		// position of this video frame in hops: `k` whole hops plus a fraction `t`
+		const auto k = frame * afpvf / hop;
+		const float t = (float)(frame * afpvf - k * hop) / hop;
+
+		const auto a = spectrum_at(k, k + 1);
+		if (!a || !t)
+			return a;
+		const auto b = spectrum_at(k + 1, k);
+		if (!b)
+			return nullptr;
+		blend(*a, *b, t, blended);
+		return &blended;
+	};
+
+	// frames to encode: all of them, or this segment's share
+	int frames = 0, end_frame = INT_MAX;
+	if (segmented)
+	{
+		// the frames of the whole video: the last one is the last whose hops all have `sample_size` samples of audio
+		const auto has_audio = [&](const long frame)
+		{
+			const auto k = frame * afpvf / hop;
+			return (k + (frame * afpvf % hop != 0)) * hop + sample_size <= sf.frames();
+		};
+		long total_frames = 0;
+		while (has_audio(total_frames))
+			++total_frames;
+		frames = total_frames * segment_index / segment_count;
+		end_frame = total_frames * (segment_index + 1) / segment_count;
+
+		// pick up the color wheel where the previous frames would have left it
+		sr.color.wheel.skip((long)frames * spectrum_count());
+
+		// the biquad filters carry state from hop to hop: let them settle on the audio leading up to the segment.
+		// the spectrogram shows as many past frames as it is high: scroll them in without drawing them.
+		// with the biquad engine, a hop is a frame
+		const auto scrolling = spectrogram && layout != Layout::RADIAL;
+		const auto rows = scrolling ? spectrum_rects(spectrum_count())[0].h : 0;
+		auto preroll = (long)rows;
+		if (engine == AnalysisEngine::BIQUAD)
+			preroll = std::max(preroll, (long)segment_preroll_seconds * sf.samplerate() / hop);
+		for (auto f = std::max(0l, frames - preroll); f < frames; ++f)
+		{
+			const auto frame = frame_spectra(f);
+			if (frame && f >= frames - rows)
+				for (int i = 0; i < frame->count; ++i)
+					sr.scroll_spectrogram(frame->spectra[i], rows, i);
+		}
+	}
+	const auto first_frame = frames;
+
+	for (; frames < end_frame; ++frames)
+	{
+		alloc_guard.begin_frame();
+
+		// a new config invalidates the analyzed spectra
+		if (adopt_analysis())
+			hops[0] = hops[1] = -1;
+
+		const auto frame = frame_spectra(frames);
+		if (!frame)
 			break;
+		encoder.write(*frame);
 
-		do_actual_rendering();
+		StageCounters::end_frame();
+		alloc_guard.end_frame();
+	}
 
-		// get pixels from renderer, send to ffmpeg
-		sr.ReadPixels(SDL2pp::NullOpt, SDL_PIXELFORMAT_RGB24, pixels, 3 * window.GetWidth());
-		if (fwrite(pixels, 1, framesize, ffmpeg) < framesize)
-			throw std::runtime_error(std::string("fwrite: ") + strerror(errno));
+	encoder.finish();
+	return frames - first_frame;
+}
+
+std::vector<int> Visualizer::encode_renditions(const std::vector<Rendition> &renditions)
+{
+	if (renditions.empty())
+		throw std::invalid_argument("Visualizer::encode_renditions: no renditions");
+
+	commit_analysis();
+	wait_for_analysis();
 
-		// seek audio backwards to synchronize with the audio file
-		sf.seek(afpvf - sample_size, SEEK_CUR);
+	int max_fps = 0;
+	for (const auto &r : renditions)
+	{
+		if (r.fps <= 0)
+			throw std::invalid_argument("Visualizer::encode_renditions: fps must be positive");
+		max_fps = std::max(max_fps, r.fps);
+
+		auto &viz = r.viz;
+		viz.commit_analysis();
+		viz.wait_for_analysis();
+		// each rendition bins this visualizer's transforms through its own config, which must lay out the bins alike
+		if (viz.sr.analysis_options() != sr.analysis_options() || viz.engine != engine || viz.analysis_channels() != analysis_channels())
+			throw std::invalid_argument("Visualizer::encode_renditions: renditions must share this visualizer's analysis options, engine and channel mode");
+		if (viz.sf.channels() != sf.channels() || viz.sf.samplerate() != sf.samplerate())
+			throw std::invalid_argument("Visualizer::encode_renditions: renditions must be of the same audio");
+		if (viz.segment_count > 1)
+			throw std::invalid_argument("Visualizer::encode_renditions: renditions can't be segmented");
+		viz.reset_biquads();
 	}
 
-	if (pclose(ffmpeg) == -1)
-		throw std::runtime_error(std::string("pclose: ") + strerror(errno));
+	// one hop serves every rendition: the analysis rate, or the highest frame rate, which the others blend from
+	const auto hop = analysis_rate && engine == AnalysisEngine::FFT ? sf.samplerate() / analysis_rate : sf.samplerate() / max_fps;
+
+	// a rendition's spectra of the last two hops, in slots `hop % 2`, and the video frames it has encoded
+	struct State
+	{
+		const Rendition &rendition;
+		VideoEncoder encoder;
+		const int bars;
+		const long afpvf;
+		SpectrumFrame spectra[2], blended;
+		int frames = 0;
+		AllocGuard alloc_guard;
+
+		State(const Rendition &rendition, const int samplerate)
+			: rendition(rendition),
+			  encoder(rendition.viz, rendition.output_file, rendition.fps, rendition.vcodec, rendition.acodec, true),
+			  bars(rendition.viz.spectrum_bars()),
+			  afpvf(samplerate / rendition.fps) {}
+	};
+	// started before any worker, so that their static layers are drawn one after the other
+	std::vector<std::unique_ptr<State>> states;
+	for (const auto &r : renditions)
+		states.push_back(std::make_unique<State>(r, sf.samplerate()));
+
+	// hop being analyzed, and whether the audio ran out before it
+	long step = 0;
+	bool last = false;
+
+	// bins hop `step` into the rendition's own spectra, then encodes every frame lying between hop `step - 1` and it
+	const auto advance = [&](State &s)
+	{
+		auto &viz = s.rendition.viz;
+		if (!last)
+		{
+			viz.bin(*this, s.spectra[step % 2], s.bars, hop);
+			s.spectra[step % 2].position = step * hop;
+		}
+		for (; step; ++s.frames)
+		{
+			// position of this video frame in hops: `k` whole hops plus a fraction `t`
+			const auto k = (long)s.frames * s.afpvf / hop;
+			const float t = (float)((long)s.frames * s.afpvf - k * hop) / hop;
+			// frames blending with a hop past the end of the audio are not encoded, as in `encode_to_video`
+			if (k != step - 1 || (last && t))
+				break;
+
+			s.alloc_guard.begin_frame();
+			if (t)
+			{
+				blend(s.spectra[k % 2], s.spectra[step % 2], t, s.blended);
+				s.encoder.write(s.blended);
+			}
+			else
+				s.encoder.write(s.spectra[k % 2]);
+			StageCounters::end_frame();
+			s.alloc_guard.end_frame();
+		}
+	};
+
+	// the calling thread analyzes, then advances the first rendition while one thread per other rendition advances it.
+	// `pool.run` publishes each hop to the workers, and their spectra back before the next transform.
+	// a rendition that throws ends the run once the hop is done, and any throw unwinds through `pool`, which releases
+	// the workers instead of leaving them waiting for the next hop
+	WorkerPool pool((int)states.size(), [&](const int i)
+					{ advance(*states[i]); });
+
+	for (;; ++step)
+	{
+		sf.seek(step * hop, SEEK_SET);
+		last = sf.readf(audio_buffer.data(), sample_size) != sample_size;
+		if (!last && engine == AnalysisEngine::FFT)
+			transform_audio();
+
+		pool.run();
+
+		if (last)
+			break;
+	}
+
+	std::vector<int> frames;
+	for (const auto &s : states)
+	{
+		s->encoder.finish();
+		frames.push_back(s->frames);
+	}
+	return frames;
 }
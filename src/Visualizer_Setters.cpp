@@ -1,9 +1,21 @@
 #include "Visualizer.hpp"
+#include "LibavEncoder.hpp"
+#include <algorithm>
+
+// a hop must advance by at least one sample, and fit in the `sample_size` samples read for it
+static void check_hop(const char *const method, const int samplerate, const int rate, const int sample_size)
+{
+	if (const auto hop = samplerate / rate; hop < 1 || hop > sample_size)
+		throw std::invalid_argument(std::string(method) + ": analysis rate " + std::to_string(rate) + " hops by " + std::to_string(hop) +
+									" samples, outside of [1, " + std::to_string(sample_size) + "]; use a rate from " +
+									std::to_string((samplerate + sample_size - 1) / sample_size) + " to " + std::to_string(samplerate) +
+									", or a larger sample size");
+}
 
 void Visualizer::set_background(const std::string &filepath)
 {
 	if (filepath.size())
-		texture_opts.bg.emplace(sr, filepath);
+		texture_opts.bg.emplace(assets->image(sr, filepath));
 	else
 		texture_opts.bg.reset();
 }
@@ -11,36 +23,150 @@ void Visualizer::set_background(const std::string &filepath)
 void Visualizer::set_album_art(const std::string &filepath)
 {
 	if (filepath.size())
-		texture_opts.album_art.emplace(sr, filepath);
+		texture_opts.album_art.emplace(assets->image(sr, filepath));
 	else
 		texture_opts.album_art.reset();
 }
 
+void Visualizer::set_spectrogram(const bool spectrogram)
+{
+	this->spectrogram = spectrogram;
+}
+
+void Visualizer::set_waveform(const std::vector<float> &spans)
+{
+	for (const auto span : spans)
+		if (span <= 0)
+			throw std::invalid_argument("Visualizer::set_waveform: spans must be positive");
+	waveform_spans = spans;
+	if (spans.empty())
+		return;
+
+	// a fresh read of the whole audio
+	waveform_sf = SndfileHandle(audio_file);
+	if (waveform_sf.error())
+		throw std::runtime_error(audio_file + ": " + waveform_sf.strError());
+	waveform_audio.resize(4096 * sf.channels());
+
+	// room reserved for all of its peaks, only from the finest level the narrowest span reads at the current width
+	const auto width = std::max(1, sr.GetOutputWidth() - 10);
+	const auto span = *std::min_element(spans.begin(), spans.end());
+	peaks = PeakPyramid(sf.frames(), PeakPyramid::level_for((double)span * sf.samplerate() / width));
+}
+
+void Visualizer::set_vectorscope(const int size, const float persistence)
+{
+	if (size < 0)
+		throw std::invalid_argument("Visualizer::set_vectorscope: size must not be negative");
+	if (!size)
+	{
+		vectorscope.reset();
+		vectorscope_texture.reset();
+		return;
+	}
+	vectorscope.emplace(size).set_persistence(persistence);
+	vectorscope_texture.emplace(sr, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, size, size);
+	vectorscope_pixels.resize(size * size);
+}
+
+void Visualizer::set_analysis_engine(const AnalysisEngine engine)
+{
+	this->engine = engine;
+}
+
+void Visualizer::set_rasterizer(const Rasterizer rasterizer, const int threads)
+{
+	if (threads <= 0)
+		throw std::invalid_argument("Visualizer::set_rasterizer: threads must be positive");
+	this->rasterizer = rasterizer;
+	raster_threads = threads;
+}
+
+void Visualizer::set_encoder_backend(const EncoderBackend backend)
+{
+	if (backend == EncoderBackend::LIBAV && !LibavEncoder::available)
+		throw std::invalid_argument("Visualizer::set_encoder_backend: built without libav, rebuild with `make libav=1`");
+	encoder_backend = backend;
+}
+
+void Visualizer::set_encode_pixel_format(const EncodePixelFormat format)
+{
+	encode_pixel_format = format;
+}
+
+void Visualizer::set_encode_segment(const int index, const int count)
+{
+	if (count <= 0)
+		throw std::invalid_argument("Visualizer::set_encode_segment: count must be positive");
+	if (index < 0 || index >= count)
+		throw std::invalid_argument("Visualizer::set_encode_segment: index must be in [0, count)");
+	segment_index = index;
+	segment_count = count;
+}
+
 void Visualizer::set_ffmpeg_path(const std::string &path)
 {
 	ffmpeg_path = path;
 }
 
+void Visualizer::set_ffmpeg_loglevel(const std::string &loglevel)
+{
+	ffmpeg_loglevel = loglevel;
+}
+
 void Visualizer::set_width(const int width)
 {
-	window.SetSize(width, window.GetHeight());
+	if (!window)
+		throw std::logic_error("Visualizer::set_width: headless visualizers have a fixed size");
+	window->SetSize(width, window->GetHeight());
 }
 
 void Visualizer::set_height(const int height)
 {
-	window.SetSize(window.GetWidth(), height);
+	if (!window)
+		throw std::logic_error("Visualizer::set_height: headless visualizers have a fixed size");
+	window->SetSize(window->GetWidth(), height);
 }
 
 void Visualizer::set_mono(const int mono)
 {
 	this->mono = mono;
+	update_analysis_channels();
+}
+
+void Visualizer::set_layout(const Layout layout)
+{
+	this->layout = layout;
+}
+
+void Visualizer::set_views(const std::vector<FS::StereoView> &views)
+{
+	if (views.size() > 2)
+		throw std::invalid_argument("Visualizer::set_views: at most two views can be drawn");
+	if (!views.empty() && sf.channels() != 2)
+		throw std::invalid_argument("Visualizer::set_views: views require stereo audio");
+	this->views = views;
+	update_analysis_channels();
+}
+
+void Visualizer::set_analysis_rate(const int rate)
+{
+	if (rate < 0)
+		throw std::invalid_argument("Visualizer::set_analysis_rate: rate cannot be negative");
+	if (rate)
+	{
+		const std::lock_guard lock(analysis_mutex);
+		check_hop("Visualizer::set_analysis_rate", sf.samplerate(), rate, requested_analysis.fft_size);
+	}
+	analysis_rate = rate;
 }
 
 void Visualizer::set_sample_size(const int sample_size)
 {
-	this->sample_size = sample_size;
-	sr.set_sample_size(sample_size);
-	audio_buffer.resize(sample_size * sf.channels());
+	if (analysis_rate)
+		check_hop("Visualizer::set_sample_size", sf.samplerate(), analysis_rate, sample_size);
+	reconfigure_analysis([&](FS::Options &opts)
+						 { opts.fft_size = sample_size; });
 }
 
 void Visualizer::set_multiplier(const float multiplier)
@@ -50,27 +176,38 @@ void Visualizer::set_multiplier(const float multiplier)
 
 void Visualizer::set_interp_type(const FS::InterpolationType interp_type)
 {
-	sr.set_interp_type(interp_type);
+	reconfigure_analysis([&](FS::Options &opts)
+						 { opts.interp = interp_type; });
 }
 
 void Visualizer::set_scale(const FS::Scale scale)
 {
-	sr.set_scale(scale);
+	reconfigure_analysis([&](FS::Options &opts)
+						 { opts.scale = scale; });
 }
 
 void Visualizer::set_nth_root(const int nth_root)
 {
-	sr.set_nth_root(nth_root);
+	reconfigure_analysis([&](FS::Options &opts)
+						 { opts.nth_root = nth_root; });
+}
+
+void Visualizer::set_resolution_bands(const int bands)
+{
+	reconfigure_analysis([&](FS::Options &opts)
+						 { opts.bands = bands; });
 }
 
 void Visualizer::set_accum_method(const FS::AccumulationMethod method)
 {
-	sr.set_accum_method(method);
+	reconfigure_analysis([&](FS::Options &opts)
+						 { opts.am = method; });
 }
 
 void Visualizer::set_window_function(const FS::WindowFunction wf)
 {
-	sr.set_window_func(wf);
+	reconfigure_analysis([&](FS::Options &opts)
+						 { opts.wf = wf; });
 }
 
 void Visualizer::set_bar_type(const SR::BarType type)
@@ -0,0 +1,68 @@
+#include "WorkerPool.hpp"
+#include <stdexcept>
+#include <utility>
+
+// validates the constructor's arguments before they size the barriers
+static int thread_count(const int threads)
+{
+	if (threads <= 0)
+		throw std::invalid_argument("WorkerPool: threads must be positive");
+	return threads;
+}
+
+WorkerPool::WorkerPool(const int threads, std::function<void(int)> job)
+	: threads(thread_count(threads)),
+	  job(std::move(job)),
+	  errors(threads),
+	  start(threads),
+	  done(threads)
+{
+	// job 0 is run by the caller of `run`
+	for (int i = 1; i < threads; ++i)
+		workers.emplace_back([this, i]
+		{
+			for (;;)
+			{
+				start.arrive_and_wait();
+				if (stopping)
+					return;
+				run_job(i);
+				done.arrive_and_wait();
+			}
+		});
+}
+
+WorkerPool::~WorkerPool()
+{
+	stopping = true;
+	start.arrive_and_wait();
+}
+
+void WorkerPool::run_job(const int index)
+{
+	// a job that throws must still arrive at `done`, or every other thread would wait forever
+	try
+	{
+		job(index);
+	}
+	catch (...)
+	{
+		errors[index] = std::current_exception();
+	}
+}
+
+void WorkerPool::run()
+{
+	start.arrive_and_wait();
+	run_job(0);
+	done.arrive_and_wait();
+
+	std::exception_ptr error;
+	for (auto &e : errors)
+		if (e && !error)
+			error = std::exchange(e, nullptr);
+		else
+			e = nullptr;
+	if (error)
+		std::rethrow_exception(error);
+}
@@ -0,0 +1,158 @@
+#include "YuvConverter.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+// BT.601 limited range in 8-bit fixed point, as swscale's default for rgb to yuv
+static uint8_t luma(const int r, const int g, const int b)
+{
+	return ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+}
+
+// chroma from the sums of four pixels, hence two more bits of shift
+static uint8_t chroma_u(const int r4, const int g4, const int b4)
+{
+	return ((-38 * r4 - 74 * g4 + 112 * b4 + 512) >> 10) + 128;
+}
+
+static uint8_t chroma_v(const int r4, const int g4, const int b4)
+{
+	return ((112 * r4 - 94 * g4 - 18 * b4 + 512) >> 10) + 128;
+}
+
+// `bpp` bytes per pixel with red at byte `ri` and blue at byte `bi`; green is always byte 1.
+// plain loops over byte offsets, which the compiler vectorizes with interleaved loads
+template <int bpp, int ri, int bi>
+static void luma_row(const uint8_t *const src, uint8_t *const dst, const int width)
+{
+	for (int x = 0; x < width; ++x)
+	{
+		const auto p = src + x * bpp;
+		dst[x] = luma(p[ri], p[1], p[bi]);
+	}
+}
+
+// `step` is 1 for separate U and V planes, 2 for NV12's interleaved plane
+template <int bpp, int ri, int bi, int step>
+static void chroma_row(const uint8_t *const top, const uint8_t *const bottom, uint8_t *const u, uint8_t *const v, const int width)
+{
+	const auto pairs = width / 2;
+	for (int cx = 0; cx < pairs; ++cx)
+	{
+		const auto a = top + 2 * cx * bpp, b = bottom + 2 * cx * bpp;
+		const int r = a[ri] + a[ri + bpp] + b[ri] + b[ri + bpp],
+				  g = a[1] + a[1 + bpp] + b[1] + b[1 + bpp],
+				  bl = a[bi] + a[bi + bpp] + b[bi] + b[bi + bpp];
+		u[cx * step] = chroma_u(r, g, bl);
+		v[cx * step] = chroma_v(r, g, bl);
+	}
+
+	// an odd last column counts twice
+	if (width % 2)
+	{
+		const auto a = top + (width - 1) * bpp, b = bottom + (width - 1) * bpp;
+		const int r = 2 * (a[ri] + b[ri]), g = 2 * (a[1] + b[1]), bl = 2 * (a[bi] + b[bi]);
+		u[pairs * step] = chroma_u(r, g, bl);
+		v[pairs * step] = chroma_v(r, g, bl);
+	}
+}
+
+template <int bpp, int ri, int bi>
+static void row_pair(const uint8_t *const top, const uint8_t *const bottom, uint8_t *const y_top, uint8_t *const y_bottom,
+					 uint8_t *const u, uint8_t *const v, const int width, const bool interleaved)
+{
+	luma_row<bpp, ri, bi>(top, y_top, width);
+	if (y_bottom)
+		luma_row<bpp, ri, bi>(bottom, y_bottom, width);
+	if (interleaved)
+		chroma_row<bpp, ri, bi, 2>(top, bottom, u, v, width);
+	else
+		chroma_row<bpp, ri, bi, 1>(top, bottom, u, v, width);
+}
+
+// validates the constructor's arguments before they size the pool
+static int band_count(const int width, const int height, const int threads)
+{
+	if (width <= 0 || height <= 0)
+		throw std::invalid_argument("YuvConverter: width and height must be positive");
+	if (threads <= 0)
+		throw std::invalid_argument("YuvConverter: threads must be positive");
+	return std::min(threads, (height + 1) / 2);
+}
+
+YuvConverter::YuvConverter(const int width, const int height, const InputFormat input_format, const OutputFormat output_format, const int threads)
+	: width(width),
+	  height(height),
+	  chroma_width((width + 1) / 2),
+	  chroma_height((height + 1) / 2),
+	  input_format(input_format),
+	  output_format(output_format),
+	  bands(band_count(width, height, threads)),
+	  // band 0 is converted by the caller of `convert`
+	  pool(bands, [this](const int band)
+		   { convert_band(band); }) {}
+
+size_t YuvConverter::frame_size(const int width, const int height)
+{
+	return (size_t)width * height + 2 * (size_t)((width + 1) / 2) * ((height + 1) / 2);
+}
+
+void YuvConverter::convert_row_pair(const int chroma_row)
+{
+	const auto y = 2 * chroma_row;
+	// an odd last row pairs with itself, and is written once
+	const auto has_bottom = y + 1 < height;
+	const auto bpp = input_format == InputFormat::BGRA ? 4 : 3;
+	const auto top = (const uint8_t *)source + (size_t)y * width * bpp;
+	const auto bottom = has_bottom ? top + (size_t)width * bpp : top;
+	const auto y_top = planes[0] + (size_t)y * strides[0];
+	const auto y_bottom = has_bottom ? y_top + strides[0] : nullptr;
+
+	const auto interleaved = output_format == OutputFormat::NV12;
+	const auto u = planes[1] + (size_t)chroma_row * strides[1];
+	const auto v = interleaved ? u + 1 : planes[2] + (size_t)chroma_row * strides[2];
+
+	switch (input_format)
+	{
+	case InputFormat::BGRA:
+		// ARGB8888 words in little-endian memory: blue, green, red, alpha
+		row_pair<4, 2, 0>(top, bottom, y_top, y_bottom, u, v, width, interleaved);
+		break;
+	case InputFormat::RGB24:
+		row_pair<3, 0, 2>(top, bottom, y_top, y_bottom, u, v, width, interleaved);
+		break;
+	default:
+		throw std::logic_error("YuvConverter::convert_row_pair: default case hit");
+	}
+}
+
+void YuvConverter::convert_band(const int band)
+{
+	const auto first = chroma_height * band / bands, last = chroma_height * (band + 1) / bands;
+	for (int cy = first; cy < last; ++cy)
+		convert_row_pair(cy);
+}
+
+void YuvConverter::convert(const void *const pixels, uint8_t *const planes[3], const int strides[3])
+{
+	source = pixels;
+	std::copy_n(planes, 3, this->planes);
+	std::copy_n(strides, 3, this->strides);
+	pool.run();
+}
+
+void YuvConverter::convert(const void *const pixels, uint8_t *const frame)
+{
+	const auto luma_size = (size_t)width * height, chroma_size = (size_t)chroma_width * chroma_height;
+	if (output_format == OutputFormat::NV12)
+	{
+		uint8_t *const planes[3]{frame, frame + luma_size, nullptr};
+		const int strides[3]{width, 2 * chroma_width, 0};
+		convert(pixels, planes, strides);
+	}
+	else
+	{
+		uint8_t *const planes[3]{frame, frame + luma_size, frame + luma_size + chroma_size};
+		const int strides[3]{width, chroma_width, chroma_width};
+		convert(pixels, planes, strides);
+	}
+}
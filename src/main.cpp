@@ -4,9 +4,6 @@
 int main(const int argc, const char *const *const argv)
 {
 	signal(SIGINT, exit);
-	setenv("SDL_VIDEODRIVER", "wayland", 1);
-	SDL2pp::SDL sdl(SDL_INIT_VIDEO);
-	SDL2pp::SDLTTF ttf;
 	try
 	{
 		Main(argc, argv);
@@ -16,4 +13,4 @@ int main(const int argc, const char *const *const argv)
 		std::cerr << argv[0] << ": " << e.what() << '\n';
 		return EXIT_FAILURE;
 	}
-}
\ No newline at end of file
+}